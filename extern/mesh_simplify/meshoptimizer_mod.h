@@ -310,11 +310,20 @@ MESHOPTIMIZER_EXPERIMENTAL void meshopt_decodeFilterExp(void* buffer, size_t ver
  * result_error can be NULL; when it's not NULL, it will contain the resulting (relative) error after simplification
  * The optional simplificationn_remap allows to keep track of the collapses. If not NULL it must contain sufficient
  * space for vertex_count unsigned int.
+ * The optional vertex_lock (vertex_count entries) marks the vertices that must not move, e.g. the vertices shared
+ * with a cube that is not part of the block.
  */
 
 MESHOPTIMIZER_EXPERIMENTAL size_t meshopt_simplify_mod(unsigned int* destination, unsigned int* simplification_remap,
  const unsigned int* indices, size_t index_count, const float* vertex_positions, size_t vertex_count, size_t vertex_positions_stride, size_t target_index_count, float target_error, 
- float* result_error, float block_extend, float block_bottom[3]);
+ float* result_error, float block_extend, float block_bottom[3], const unsigned char* vertex_lock);
+
+/**
+ * Experimental: AVX2 quadric evaluation of meshopt_simplify_mod, used when the CPU has it.
+ * enabled: 1 allows it, 0 forces the scalar code (same results), -1 only queries.
+ * Returns 1 when the simplifier runs the AVX2 code.
+ */
+MESHOPTIMIZER_EXPERIMENTAL int meshopt_simplifySimd(int enabled);
 
 
 
@@ -8,6 +8,15 @@
 
 #include "meshoptimizer_mod.h"
 
+// AVX2 quadric kernels, compiled for the target of their own and picked at
+// runtime: the build itself stays on the baseline x86-64
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+	#define SIMPLIFY_AVX2 1
+	#include <immintrin.h>
+#else
+	#define SIMPLIFY_AVX2 0
+#endif
+
 #ifndef TRACE
 	#define TRACE 0
 #endif
@@ -848,11 +857,147 @@ static void rankEdgeCollapses(Collapse *collapses, size_t collapse_count,
 		c.v0 = ei <= ej ? i0 : j0;
 		c.v1 = ei <= ej ? i1 : j1;
 		c.error = ei <= ej ? ei : ej;
+#if TRACE
 		if (c.error == 0)
 			printf("Zero error!\n");
+#endif
 	}
 }
 
+#if SIMPLIFY_AVX2
+static_assert(sizeof(Quadric) == 11 * sizeof(float), "quadric gathers");
+static_assert(sizeof(Vector3) == 3 * sizeof(float), "position gathers");
+static_assert(sizeof(Collapse) == 3 * sizeof(unsigned int), "collapse gathers");
+
+// The ranking below evaluates 8 collapses per instruction with the operations
+// of the scalar code in the same order and without FMA, its results are
+// bit-exact. The quadrics stay AoS, the lanes gather their fields: they are
+// merged after each pass of collapses, an SoA copy would have to be rebuilt.
+// fillFaceQuadrics stays scalar, its cost is the scatter of the quadric sums
+
+__attribute__((target("avx2"))) static inline __m256
+gatherField(const float *base, __m256i index, int field)
+{
+	return _mm256_i32gather_ps(base + field, index, 4);
+}
+
+// quadricError of 8 quadrics (field index q) at 8 positions
+__attribute__((target("avx2"))) static inline __m256
+quadricErrorAvx2(const float *quadrics, __m256i q, __m256 vx, __m256 vy,
+		 __m256 vz)
+{
+	__m256 two = _mm256_set1_ps(2.f);
+	__m256 rx = _mm256_add_ps(gatherField(quadrics, q, 6), _mm256_mul_ps(gatherField(quadrics, q, 3), vy));
+	__m256 ry = _mm256_add_ps(gatherField(quadrics, q, 7), _mm256_mul_ps(gatherField(quadrics, q, 5), vz));
+	__m256 rz = _mm256_add_ps(gatherField(quadrics, q, 8), _mm256_mul_ps(gatherField(quadrics, q, 4), vx));
+
+	rx = _mm256_add_ps(_mm256_mul_ps(rx, two), _mm256_mul_ps(gatherField(quadrics, q, 0), vx));
+	ry = _mm256_add_ps(_mm256_mul_ps(ry, two), _mm256_mul_ps(gatherField(quadrics, q, 1), vy));
+	rz = _mm256_add_ps(_mm256_mul_ps(rz, two), _mm256_mul_ps(gatherField(quadrics, q, 2), vz));
+
+	__m256 r = gatherField(quadrics, q, 9);
+	r = _mm256_add_ps(r, _mm256_mul_ps(rx, vx));
+	r = _mm256_add_ps(r, _mm256_mul_ps(ry, vy));
+	r = _mm256_add_ps(r, _mm256_mul_ps(rz, vz));
+
+	__m256 w = gatherField(quadrics, q, 10);
+	__m256 zero = _mm256_setzero_ps();
+	__m256 s = _mm256_blendv_ps(_mm256_div_ps(_mm256_set1_ps(1.f), w), zero, _mm256_cmp_ps(w, zero, _CMP_EQ_OQ));
+
+	return _mm256_mul_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.f), r), s);
+}
+
+__attribute__((target("avx2"))) static void
+rankEdgeCollapsesAvx2(Collapse *collapses, size_t collapse_count,
+		      const Vector3 *vertex_positions,
+		      const Quadric *vertex_quadrics,
+		      const unsigned int *remap)
+{
+	const float *positions = &vertex_positions[0].x;
+	const float *quadrics = &vertex_quadrics[0].a00;
+	const int *remapi = (const int *)remap;
+	const __m256i stride3 = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+	const __m256i three = _mm256_set1_epi32(3);
+	const __m256i eleven = _mm256_set1_epi32(11);
+
+	size_t i = 0;
+	for (; i + 8 <= collapse_count; i += 8) {
+		const int *base = (const int *)&collapses[i];
+		__m256i i0 = _mm256_i32gather_epi32(base, stride3, 4);
+		__m256i i1 = _mm256_i32gather_epi32(base + 1, stride3, 4);
+		__m256i bidi = _mm256_i32gather_epi32(base + 2, stride3, 4);
+
+		// j0, j1: the reverse collapse of a bidirectional edge
+		__m256i isBidi = _mm256_xor_si256(_mm256_cmpeq_epi32(bidi, _mm256_setzero_si256()), _mm256_set1_epi32(-1));
+		__m256i j0 = _mm256_blendv_epi8(i0, i1, isBidi);
+		__m256i j1 = _mm256_blendv_epi8(i1, i0, isBidi);
+
+		__m256i qi = _mm256_mullo_epi32(_mm256_i32gather_epi32(remapi, i0, 4), eleven);
+		__m256i qj = _mm256_mullo_epi32(_mm256_i32gather_epi32(remapi, j0, 4), eleven);
+
+		__m256i pi0 = _mm256_mullo_epi32(i0, three);
+		__m256i pi1 = _mm256_mullo_epi32(i1, three);
+		__m256i pj1 = _mm256_mullo_epi32(j1, three);
+		__m256 x1 = gatherField(positions, pi1, 0);
+		__m256 y1 = gatherField(positions, pi1, 1);
+		__m256 z1 = gatherField(positions, pi1, 2);
+
+		__m256 ei = quadricErrorAvx2(quadrics, qi, x1, y1, z1);
+		__m256 ej = quadricErrorAvx2(quadrics, qj, gatherField(positions, pj1, 0),
+					    gatherField(positions, pj1, 1), gatherField(positions, pj1, 2));
+
+		// Hack Didier, in double like the scalar code
+		__m256 dx = _mm256_sub_ps(gatherField(positions, pi0, 0), x1);
+		__m256 dy = _mm256_sub_ps(gatherField(positions, pi0, 1), y1);
+		__m256 dz = _mm256_sub_ps(gatherField(positions, pi0, 2), z1);
+		__m256 plane_error = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+
+		__m256d factor = _mm256_set1_pd(0.01);
+		__m256d pe_lo = _mm256_mul_pd(factor, _mm256_cvtps_pd(_mm256_castps256_ps128(plane_error)));
+		__m256d pe_hi = _mm256_mul_pd(factor, _mm256_cvtps_pd(_mm256_extractf128_ps(plane_error, 1)));
+		ei = _mm256_set_m128(_mm256_cvtpd_ps(_mm256_add_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(ei, 1)), pe_hi)),
+				     _mm256_cvtpd_ps(_mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(ei)), pe_lo)));
+		ej = _mm256_set_m128(_mm256_cvtpd_ps(_mm256_add_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(ej, 1)), pe_hi)),
+				     _mm256_cvtpd_ps(_mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(ej)), pe_lo)));
+
+		// pick edge direction with minimal error
+		__m256 isI = _mm256_cmp_ps(ei, ej, _CMP_LE_OQ);
+		alignas(32) unsigned int v0[8], v1[8];
+		alignas(32) float error[8];
+		_mm256_store_si256((__m256i *)v0, _mm256_blendv_epi8(j0, i0, _mm256_castps_si256(isI)));
+		_mm256_store_si256((__m256i *)v1, _mm256_blendv_epi8(j1, i1, _mm256_castps_si256(isI)));
+		_mm256_store_ps(error, _mm256_blendv_ps(ej, ei, isI));
+
+		for (int lane = 0; lane < 8; ++lane) {
+			Collapse &c = collapses[i + lane];
+			c.v0 = v0[lane];
+			c.v1 = v1[lane];
+			c.error = error[lane];
+#if TRACE
+			if (c.error == 0)
+				printf("Zero error!\n");
+#endif
+		}
+	}
+
+	rankEdgeCollapses(collapses + i, collapse_count - i, vertex_positions,
+			  vertex_quadrics, remap);
+}
+
+static bool hasAvx2()
+{
+	static const bool isSupported = __builtin_cpu_supports("avx2");
+	return isSupported;
+}
+#else
+static bool hasAvx2()
+{
+	return false;
+}
+#endif
+
+static bool isSimdEnabled = true;
+
 #if TRACE > 1
 static void dumpEdgeCollapses(const Collapse *collapses, size_t collapse_count,
 			      const unsigned char *vertex_kind)
@@ -1142,6 +1287,15 @@ static void remapEdgeLoops(unsigned int *loop, size_t vertex_count,
 
 } // namespace meshopt
 
+int meshopt_simplifySimd(int enabled)
+{
+	using namespace meshopt;
+
+	if (enabled >= 0)
+		isSimdEnabled = enabled != 0;
+	return isSimdEnabled && hasAvx2();
+}
+
 //#ifndef NDEBUG
 unsigned char *meshopt_simplifyDebugKind = 0;
 unsigned int *meshopt_simplifyDebugLoop = 0;
@@ -1155,7 +1309,7 @@ size_t meshopt_simplify_mod(unsigned int *destination,
 			    size_t vertex_count, size_t vertex_positions_stride,
 			    size_t target_index_count, float target_error,
 			    float *out_result_error, float extent,
-			    float offset[3])
+			    float offset[3], const unsigned char *vertex_lock)
 {
 	using namespace meshopt;
 
@@ -1228,6 +1382,18 @@ size_t meshopt_simplify_mod(unsigned int *destination,
 				     vertex_count, vertex_positions_stride);
 	}
 
+	// Rui
+	// locked vertices keep their position, other vertices can still
+	// collapse onto them
+	if (vertex_lock) {
+		for (size_t i = 0; i < vertex_count; ++i)
+			if (vertex_lock[i])
+				vertex_kind[remap[i]] = Kind_Locked;
+
+		for (size_t i = 0; i < vertex_count; ++i)
+			vertex_kind[i] = vertex_kind[remap[i]];
+	}
+
 	// Didier (for us target_error was in absolute metric)
 	target_error /= extent;
 
@@ -1276,8 +1442,16 @@ size_t meshopt_simplify_mod(unsigned int *destination,
 		if (edge_collapse_count == 0)
 			break;
 
-		rankEdgeCollapses(edge_collapses, edge_collapse_count,
-				  vertex_positions, vertex_quadrics, remap);
+#if SIMPLIFY_AVX2
+		if (isSimdEnabled && hasAvx2())
+			rankEdgeCollapsesAvx2(edge_collapses, edge_collapse_count,
+					      vertex_positions, vertex_quadrics,
+					      remap);
+		else
+#endif
+			rankEdgeCollapses(edge_collapses, edge_collapse_count,
+					  vertex_positions, vertex_quadrics,
+					  remap);
 
 #if TRACE > 1
 		dumpEdgeCollapses(edge_collapses, edge_collapse_count,
@@ -2,25 +2,36 @@
 
 #include "Shader.h"
 #include "Cube.h"
-#include <unordered_map>
+#include "HLOD.h"
+#include "RenderList.h"
+#include <vector>
 
 static constexpr uint32_t SC_INDICES_BBX[24] = {4, 5, 5, 6, 6, 7, 7, 4,
                                                 0, 1, 1, 2, 2, 3, 3, 0,
                                                 0, 5, 3, 4, 2, 7, 1, 6};
+
+/* Per instance data of a drawn box */
+struct BbxInstance
+{
+    float bottom[3];
+    float length;
+    int level;
+};
+
+/* Boxes of the selected cubes, one instanced draw of a unit cube scaled and moved per instance */
 struct BoundingBoxDraw
 {
-    unordered_map<uint64_t, size_t> vboOffset;
-    unordered_map<uint64_t, size_t> eboOffset;
     GLuint bbxVAO;
-    GLuint bbxVBO;
-    GLuint bbxEBO;
-    uint32_t vertexOffset = 0;
-    uint32_t idxOffset = 0;
+    GLuint bbxVBO;                      /* unit cube corners */
+    GLuint bbxEBO;                      /* 12 edges */
+    GLuint instanceVBO;                 /* bottom, length and level of the boxes of the frame */
+    size_t instanceCapacity = 0;
+    vector<BbxInstance> instances;
 
     BoundingBoxDraw();
     ~BoundingBoxDraw();
 
-    void InitBuffer(Cube &cube, float length);
-    void Render(Cube &cube, Shader *bbxShader, float length, int level);
-    void FlushBuffer(Cube &cube);
+    void InitBuffer();
+    void Render(HLOD &hlod, const RenderList &list, Shader *bbxShader);
+    void Destroy();
 };
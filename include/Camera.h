@@ -161,4 +161,13 @@ struct Camera
 
 int is_visible(const Aabb& bbox, const float *pvm);
 
+/**
+ * Frustum planes (a, b, c, d) from the clip matrix, normalised so that
+ * a * x + b * y + c * z + d is the signed distance, positive inside.
+ */
+void frustum_planes(const float *pvm, float planes[24]);
+
+/* Sphere against the frustum planes: 0 outside, 1 intersecting, 2 fully inside */
+int is_visible(const float *center, float radius, const float planes[24]);
+
 
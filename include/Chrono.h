@@ -3,6 +3,8 @@
 
 void TimerStart();
 unsigned int TimerStop(const char *str = "");
+/* Seconds on a monotonic clock, safe from any thread */
+double TimerNow();
 
 char *GetCurrentTime();
 void GetElapsedTime(timeval start, timeval end, const char *str);
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/* Instruction sets the hot kernels are built for, the binary itself targets baseline x86-64 */
+enum CpuLevel
+{
+    SC_CPU_SSE2,
+    SC_CPU_AVX2,
+    SC_CPU_AVX512,
+    SC_CPU_LEVEL_COUNT
+};
+
+/* Kernels built once per instruction set, the same results on every level */
+struct CpuKernels
+{
+    /* Grow min/max with the positions, xyz per vertex */
+    void (*bounds)(const float *positions, size_t vertCount, float min[3], float max[3]);
+    /* Unit normal of each triangle, xyz per triangle, zero for a degenerate one */
+    void (*faceNormals)(const float *positions, const uint32_t *indices, size_t indexCount, float *normals);
+    /* Normalize the xyz vectors in place, zero vectors stay */
+    void (*normalize)(float *vectors, size_t count);
+    /* indices[i] = remap[indices[i]] */
+    void (*remapIndices)(uint32_t *indices, size_t indexCount, const uint32_t *remap);
+    /* destination[i] = source[i] + offset */
+    void (*offsetIndices)(uint32_t *destination, const uint32_t *source, size_t indexCount, uint32_t offset);
+};
+
+/* Kernels of the selected level, SSE2 until SelectCpuKernels */
+extern CpuKernels cpuKernels;
+
+/* Highest level of this CPU */
+CpuLevel DetectCpuLevel();
+/* Select the kernels of the level, lowered to what the CPU runs, returns the selected level */
+CpuLevel SelectCpuKernels(CpuLevel level);
+const char *CpuLevelName(CpuLevel level);
+
+/* Time every kernel on each level the CPU runs, against the SSE2 results */
+void BenchmarkKernels(const float *positions, size_t vertCount, const uint32_t *indices, size_t indexCount);
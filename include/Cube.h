@@ -13,18 +13,32 @@ using namespace std;
 
 struct Cube
 {
-    float bbxVertices[24];
     float bottom[3]{FLT_MAX, FLT_MAX, FLT_MAX};
     float top[3]{FLT_MIN, FLT_MIN, FLT_MIN};
     int coord[3];
     uint64_t coord64;
     size_t vertexOffset = 0;
     size_t idxOffset = 0;
+    size_t idxByteOffset = 0;           /* first index in the GPU index stream, bytes */
+    int indexSize = 4;                  /* bytes per index in the GPU stream, 2 when the cube has fewer than 65536 vertices */
     int vertCount = 0;
     int triangleCount = 0;
+    bool isLeaf = false;                /* holds input triangles, no finer cube below */
+    float error = 0.0f;                 /* simplification error to the input surface, model units */
+    float tightMin[3]{FLT_MAX, FLT_MAX, FLT_MAX};       /* bounds of the geometry of the cube and its descendants */
+    float tightMax[3]{-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    float center[3]{};                  /* bounding sphere of the same geometry */
+    float radius = 0.0f;
+    size_t parentBase = 0;              /* first vertex of the parent cube, the root morphs to itself */
+    int parentIdx = -1;                 /* index of the parent in the cube array of the coarser level */
+    int childIdx = -1;                  /* index of the first child in the cube array of the finer level */
+    unsigned char childMask = 0;        /* bit ix * 4 + iy * 2 + iz set for each existing child octant */
 
     Cube();
     Cube(float min[3], float max[3]) {}
     void ComputeBottomVertex(float bottom[3], int coord[3], float length, float min[3]);
-    void CalculateBBXVertex(float length);
+    /* Tight bounds and bounding sphere of the vertices and of the bounds of the children */
+    void ComputeTightBounds(const float *positions, int count, Cube **children, int childCount);
+    /* Grow the bounds with a point, e.g. the parent position a vertex morphs to */
+    void ExpandBounds(const float *point);
 };
@@ -3,27 +3,119 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <stack>
 #include <algorithm>
 #include <utility>
 #include <unordered_map>
 #include <queue>
+#include <pthread.h>
 #include "Shader.h"
 #include "Camera.h"
 #include "HLOD.h"
 #include "Viewer.h"
 #include "Frustum.h"
 #include "BoundingBoxDraw.h"
+#include "RenderList.h"
+#include "OcclusionCulling.h"
 #include "Chrono.h"
+#include "Headless.h"
+#include "FrameCapture.h"
+#include "ShaderVariants.h"
+#include "GpuUpload.h"
+#include "ProgressiveBuild.h"
+#include "Trace.h"
+#include "FrameStats.h"
+#include "Telemetry.h"
+#include "GlState.h"
 
 using namespace std;
 
+static constexpr GLuint SC_UBO_MATRICES = 0;       /* uniform buffer bindings of the shaders */
+static constexpr GLuint SC_UBO_FRAME = 1;
+
+/* std140 image of the FrameParameters block of the default shader */
+struct FrameParameters
+{
+    float vp[3];
+    float sigma;
+    float freezeVp[3];
+    int maxLevel;
+    float kappa[SC_MAX_LOD_LEVEL][4];               /* std140 arrays step by 16 bytes */
+};
+static_assert(sizeof(FrameParameters) == 32 + 16 * SC_MAX_LOD_LEVEL, "FrameParameters does not match the std140 block");
+
+/* Camera and settings sampled by the render thread, the selection reads nothing else */
+struct SelectionInput
+{
+    Mat4 pvm;
+    Mat4 model;
+    Vec3 viewpoint;
+    float modelScale;
+    float nearPlane;            /* clip w of the camera near plane */
+    float pixelScale;
+    float pixelError;
+    float sigma;
+    int triangleBudget;
+    bool isFrustumCulling;
+    bool isTriangleBudget;
+    bool isOcclusionCulling;
+    int frame;
+    double sampleTime;          /* s */
+    size_t residentCubes[SC_MAX_LOD_LEVEL];     /* uploaded cubes of each cube array, a prefix of it */
+};
+
+/* Selection thread: computes the list of frame N + 1 while the render thread draws frame N */
+struct SelectionWorker
+{
+    HLOD *hlod;
+    int maxLevel;
+    OcclusionCuller *culler;
+    RenderListExchange exchange;
+    pthread_t thread;
+    pthread_mutex_t inputMutex;
+    pthread_cond_t inputCond;
+    pthread_mutex_t selectMutex;    /* one selection at a time, the synchronous one included */
+    SelectionInput input;           /* latest camera sample, guarded by inputMutex */
+    bool hasInput = false;
+    bool isRunning = true;
+};
+
+/* Select, sort and cull into the back list and publish it */
+void RunSelection(SelectionWorker *worker, const SelectionInput &in);
+/* Hand the latest camera sample to the selection thread */
+void PostSelection(SelectionWorker *worker, const SelectionInput &in);
+void *SelectionLoop(void *arg);
+
+void ComputeLevelKappa(LOD *meshbook[], int maxLevel, float modelScale, float pixelScale, float pixelError, float sigma);
+
+/* Cube candidate of the triangle budget selection */
+struct CubeRefinement
+{
+    float priority;         /* distance threshold over distance, refined first when larger */
+    int lodIdx;             /* index in the LOD array */
+    Cube *cube;
+    bool isInside;          /* fully inside the frustum, the children skip the frustum test */
+
+    bool operator<(const CubeRefinement &b) const { return priority < b.priority; }
+};
+
+float RefinementPriority(LOD *mg, Cube &cube, Mat4 &model);
+
+/* Refine the cubes by priority until the triangle budget is reached, return the scale of the distance factors */
+float SelectCubeBudget(LOD *meshbook[], int maxLevel, Mat4 &pvmMat, Mat4 &model, size_t triBudget);
+
 void SelectCubeVisbility(LOD *meshbook[], int maxLevel, Mat4 &pvmMat, Mat4 &model);
 
-int LoadChildCube(int parentCoord[3], LOD *meshbook[], Mat4 &pvmMat, Mat4 &model, Camera *camera, int maxLevel, int curLevel);
+/* isInside: the parent is fully inside the frustum, the children are not tested */
+int LoadChildCube(Cube &parent, LOD *meshbook[], Mat4 &pvmMat, Mat4 &model, int maxLevel, int curLevel, bool isInside);
+
+float CalculateDistanceToCube(Cube &cube, Vec3 viewpoint, Mat4 &model);
 
-float CalculateDistanceToCube(float cubeBottom[3], Vec3 viewpoint, Mat4 &model, float cubeLength);
+/* The children of the cube are on the GPU, else the cube is drawn instead of them */
+bool IsChildrenResident(Cube &cube, int childLodIdx);
 
-bool AfterFrustumCulling(Cube &cube, Mat4 pvm);
+/* 0 outside the frustum, 1 intersecting, 2 fully inside */
+int FrustumTest(Cube &cube, Mat4 &pvm);
 
-int Display(HLOD &multiResoModel, int maxLevel);
+/* headless: render the camera path offscreen instead of the interactive window,
+ * build: hierarchy built in the background, it replaces multiResoModel once ready */
+int Display(HLOD &multiResoModel, int maxLevel, HeadlessParams *headless = NULL, ProgressiveBuild *build = NULL);
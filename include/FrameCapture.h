@@ -0,0 +1,65 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <pthread.h>
+
+using namespace std;
+
+static constexpr int SC_CAPTURE_RING = 3;         /* frames in flight between the readback and the map */
+static constexpr int SC_CAPTURE_WRITERS = 2;      /* encoding threads */
+static constexpr size_t SC_CAPTURE_QUEUE = 16;    /* frames waiting for a writer, bounds the memory */
+
+/* Pixel buffer the GPU copies a frame to, mapped once its fence has signaled */
+struct CaptureSlot
+{
+    GLuint pbo = 0;
+    GLsync fence = 0;
+    size_t size = 0;
+    string file;
+    int width = 0;
+    int height = 0;
+};
+
+/* Frame handed to the writer threads, RGB rows bottom up */
+struct CaptureJob
+{
+    string file;
+    int width;
+    int height;
+    vector<unsigned char> pixels;
+};
+
+/* Screenshots and frame sequences without stalling the render thread: the frame is read into a ring
+ * of PBOs, mapped a few frames later and encoded to TGA or PNG (from the file extension) by writer threads */
+struct FrameCapture
+{
+    CaptureSlot slots[SC_CAPTURE_RING];
+    int head = 0;                           /* oldest slot in flight */
+    int inFlight = 0;
+    pthread_t writers[SC_CAPTURE_WRITERS];
+    pthread_mutex_t mutex;
+    pthread_cond_t jobCond;                 /* a job is queued or the writers stop */
+    pthread_cond_t doneCond;                /* a job is written */
+    deque<CaptureJob *> jobs;
+    vector<CaptureJob *> freeJobs;          /* pixel buffers reused from frame to frame */
+    int busyWriters = 0;
+    bool isRunning = false;
+    size_t capturedCount = 0;               /* frames read back and queued to the writers */
+    size_t droppedCount = 0;                /* frames whose readback could not be mapped */
+    size_t stallCount = 0;                  /* captures that had to wait for the GPU or the writers */
+
+    void Init();
+    /* Queue the readback of the read buffer of the bound read framebuffer */
+    void Capture(const string &file, int width, int height, GLenum readBuffer);
+    /* Hand the finished readbacks to the writers, never blocks */
+    void Poll();
+    /* Wait for every queued frame to be written */
+    void Flush();
+    void Destroy();
+
+    /* Map the oldest slot and queue its pixels, waiting for its fence if isWait */
+    bool Retire(bool isWait);
+    void *WriteLoop();
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include <glad/glad.h>
+#include <stddef.h>
+
+static constexpr int SC_GPU_TIMER_RING = 4;         /* frames of queries in flight, read back without waiting */
+static constexpr int SC_FRAME_HISTORY = 256;        /* frames of the plots and percentiles */
+
+/* GPU passes timed with GL_TIME_ELAPSED, one query each, never nested */
+enum GpuPass
+{
+    SC_GPU_PASS_SCENE,
+    SC_GPU_PASS_BBOX,
+    SC_GPU_PASS_UI,
+    SC_GPU_PASS_COUNT
+};
+
+/* Times of a frame, ms */
+enum FrameMetric
+{
+    SC_METRIC_FRAME,            /* between the starts of two frames */
+    SC_METRIC_CPU,              /* render thread work of the frame */
+    SC_METRIC_SELECTION,        /* selection of the drawn list, list build included */
+    SC_METRIC_LIST,             /* sort and occlusion culling of the drawn list */
+    SC_METRIC_UPLOAD,           /* streamed upload step */
+    SC_METRIC_SUBMIT,           /* draw calls of the scene and the boxes */
+    SC_METRIC_GPU_SCENE,        /* GPU passes, from the last frame read back */
+    SC_METRIC_GPU_BBOX,
+    SC_METRIC_GPU_UI,
+    SC_METRIC_COUNT
+};
+
+extern const char *frameMetricNames[SC_METRIC_COUNT];
+
+/* Time elapsed queries of SC_GPU_TIMER_RING frames: a frame is read back once all its queries are available,
+ * a frame finding the ring full is not timed rather than waiting for the GPU */
+struct GpuTimerRing
+{
+    GLuint queries[SC_GPU_TIMER_RING][SC_GPU_PASS_COUNT]{};
+    bool isIssued[SC_GPU_TIMER_RING][SC_GPU_PASS_COUNT]{};
+    int frames[SC_GPU_TIMER_RING]{};
+    int head = 0;                           /* oldest frame in flight */
+    int inFlight = 0;
+    bool isTiming = false;                  /* the current frame has a slot */
+    int activePass = -1;
+    float passTime[SC_GPU_PASS_COUNT]{};    /* ms, last frame read back */
+    int resultFrame = -1;
+    size_t skippedCount = 0;                /* frames not timed, the ring was full */
+
+    void Init();
+    void Destroy();
+    /* Read the finished frames back and take a slot for this one */
+    void BeginFrame(int frame);
+    void EndFrame();
+    void Begin(GpuPass pass);
+    void End();
+    /* Read back the oldest frames whose queries are all available, true if one was */
+    bool Collect();
+};
+
+/* Last SC_FRAME_HISTORY values of every metric */
+struct FrameStats
+{
+    float history[SC_METRIC_COUNT][SC_FRAME_HISTORY]{};
+    float latest[SC_METRIC_COUNT]{};
+    int offset = 0;                         /* next slot, the oldest value once the history is full */
+    int count = 0;
+
+    void Push(const float *values);
+    /* Value under which the share p of the history lies, 0 <= p <= 1 */
+    float Percentile(FrameMetric metric, float p) const;
+    /* History of the metric in increasing order, returns the value count */
+    int Sorted(FrameMetric metric, float *values) const;
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include <glad/glad.h>
+
+static constexpr int SC_GL_BINDINGS = 8;        /* indexed binding points shadowed per target */
+
+/* GL calls of a frame */
+struct GlCallCounters
+{
+    unsigned draws = 0;
+    unsigned uniforms = 0;                      /* glUniform* */
+    unsigned programs = 0;                      /* glUseProgram */
+    unsigned binds = 0;                         /* vertex arrays and indexed buffers */
+    unsigned droppedBinds = 0;                  /* program and binding changes to what was bound already */
+    unsigned bufferUpdates = 0;                 /* glBufferSubData of the uniform buffers */
+};
+
+/* Shadow of the program, the vertex array and the indexed buffer bindings, a change to what is bound
+ * already is dropped. Code binding behind its back must Invalidate; ImGui restores what it changes */
+struct GlState
+{
+    GLuint program = 0;
+    GLuint vao = 0;
+    GLuint storageBuffers[SC_GL_BINDINGS]{};
+    GLuint uniformBuffers[SC_GL_BINDINGS]{};
+    GlCallCounters frame;                       /* calls of the frame being drawn */
+    GlCallCounters last;                        /* calls of the last complete frame */
+
+    void UseProgram(GLuint id);
+    void BindVertexArray(GLuint id);
+    /* GL_SHADER_STORAGE_BUFFER or GL_UNIFORM_BUFFER */
+    void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+    void CountDraw() { frame.draws++; }
+    void CountUniform() { frame.uniforms++; }
+    void CountBufferUpdate() { frame.bufferUpdates++; }
+    /* Publish the counters of the frame and start the next one */
+    void EndFrame();
+    /* Forget the shadowed state, e.g. after deleting bound objects: their names may come back */
+    void Invalidate();
+};
+
+extern GlState glState;
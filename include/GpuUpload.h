@@ -0,0 +1,49 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+#include "LOD.h"
+
+using namespace std;
+
+static constexpr size_t SC_UPLOAD_SLICE = 16 << 20;     /* bytes copied per frame */
+static constexpr int SC_UPLOAD_RING = 3;                /* staging slices in flight */
+
+/* Bytes of a source array copied to a GPU buffer */
+struct UploadRange
+{
+    GLuint buffer;
+    size_t offset;                          /* in the GPU buffer */
+    size_t size;
+    const unsigned char *data;
+    int lodIdx;                             /* last range of a cube of this LOD, -1 otherwise */
+};
+
+/* Streams the model to immutable GPU buffers in bounded slices through a persistently mapped staging
+ * buffer, one fence per slice. The cubes are queued coarse levels first, a cube is resident once all
+ * its ranges are copied: residentCubes[lodIdx] counts the resident cubes of the cube array of the LOD */
+struct GpuUploader
+{
+    GLuint staging = 0;
+    unsigned char *mapped = NULL;
+    GLsync fences[SC_UPLOAD_RING]{};
+    int slice = 0;
+    vector<UploadRange> ranges;             /* upload order */
+    size_t cursor = 0;                      /* range being copied */
+    size_t rangeDone = 0;                   /* bytes of the range already copied */
+    size_t residentCubes[SC_MAX_LOD_LEVEL]{};
+    size_t uploadedBytes = 0;
+    size_t totalBytes = 0;
+
+    bool Init();
+    /* GPU only storage, filled by the copies */
+    GLuint CreateBuffer(size_t size);
+    void Add(GLuint buffer, size_t offset, const void *data, size_t size);
+    /* The ranges added since the last call make a cube of the LOD */
+    void EndCube(int lodIdx);
+    /* Copy at most one slice, skipped while the GPU still reads the slice, return false once all is resident */
+    bool Step();
+    /* Copy everything left, waiting for the slices */
+    void Flush();
+    bool IsDone() const { return cursor == ranges.size(); }
+    void Destroy();
+};
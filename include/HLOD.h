@@ -1,16 +1,27 @@
-#pragma once 
+#pragma once
 #include "LOD.h"
 
 struct HLOD
 {
     float min[3]{FLT_MAX, FLT_MAX, FLT_MAX}; /* min value of model*/
     float max[3]{FLT_MIN, FLT_MIN, FLT_MIN}; /* max value of model*/
-    LOD *lods[SC_MAX_LOD_LEVEL];
+    LOD *lods[SC_MAX_LOD_LEVEL]{};
     Mesh data;
     size_t curIdxOffset = 0;
     size_t curVertOffset = 0;
+    size_t leafTriBudget = 0;               /* adaptive subdivision: max triangles of a leaf cube, 0 for uniform depth */
+    size_t leafTriCount = 0;                /* input data stored in the leaf cubes */
+    size_t leafVertCount = 0;
 
     HLOD();
     /* Build the highest resolution data based on input data */
     void BuildLODFromInput(Mesh *rawMesh, size_t vertCount, size_t triCount);
-};
\ No newline at end of file
+    /* Split a cube only if it exceeds the triangle budget, move the triangles to their leaf cube */
+    void AdaptiveSubdivision(uint64_t *triangleToCube, size_t triCount);
+    /* Fill the cube arrays from the root down and link the cubes by index, the runtime walks no hashmap */
+    void LinkCubes(int maxLevel);
+    /* Interleaved vertices with the position and normal of their parent vertex, data.posCount entries */
+    void BuildMorphVertices(int maxLevel, MorphVertex *vertices);
+    /* GPU index stream: 16 bits indices for the cubes that fit, 32 bits for the others, return the 32 bits cube count */
+    size_t BuildIndexStream(int maxLevel, vector<unsigned char> &stream);
+};
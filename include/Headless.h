@@ -0,0 +1,50 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include "Camera.h"
+
+using namespace std;
+
+/* Offscreen mode settings from the command line */
+struct HeadlessParams
+{
+    string pathFile;                /* camera path to replay, "turntable:N" orbits N frames around the model */
+    string outputDir = ".";         /* timings.csv and the frame images */
+    int width = 1920;
+    int height = 1080;
+    bool isSaveImage = false;       /* one PNG per frame */
+};
+
+/* Camera pose of each frame, one "px py pz qx qy qz qw" line per frame in the file */
+struct CameraPath
+{
+    vector<Vec3> positions;
+    vector<Quat> rotations;
+
+    bool Load(const string &file);
+    bool Save(const string &file);
+    void Append(const Camera &camera);
+    /* Full turn around the vertical axis through the target, starting from the camera pose */
+    void Turntable(const Camera &camera, const Vec3 &target, int frameCount);
+    void Apply(size_t frame, Camera &camera);
+    size_t Size() { return positions.size(); }
+};
+
+/* Surfaceless EGL context, needs no window system: Mesa llvmpipe runs it on a machine without GPU */
+bool InitHeadlessContext();
+void DestroyHeadlessContext();
+
+/* Framebuffer object the offscreen frames are rendered to */
+struct OffscreenTarget
+{
+    GLuint fbo = 0;
+    GLuint color = 0;
+    GLuint depth = 0;
+    int width = 0;
+    int height = 0;
+
+    bool Init(int w, int h);
+    void Bind();
+    void Destroy();
+};
@@ -6,6 +6,8 @@
 #include <fstream>
 #include <chrono>
 #include <thread>
+#include "FrameStats.h"
+#include "GlState.h"
 
 struct ImguiLayer
 {
@@ -18,12 +20,31 @@ struct ImguiLayer
     
     unsigned char* gpuVendorStr;                /* GPU vendor and model */
     unsigned char* gpuModelStr;
-    float kappa = 4.0f;                         /* adaptive HLOD parameter value */
+    float pixelError = 2.0f;                    /* tolerated projected simplification error in pixels */
     float sigma = 0.1f;
     float gpuUsage;                             /* GPU usage*/
     float overdrawRatio = 0.0f;
     int renderCubeCount = 0;                    /* Number of rendered cells */
-    std::ofstream out;                          /*out file stream */
+    int triangleBudget = 2000000;               /* max triangles of the budget selection */
+    float budgetScale = 1.0f;                   /* distance factor scale chosen by the budget selection */
+    size_t occludedCubeCount = 0;               /* cubes removed by the occlusion culling */
+    size_t occluderTriCount = 0;
+    float occlusionTime = 0.0f;                 /* ms */
+    float selectionTime = 0.0f;                 /* ms, cube selection of the drawn list */
+    float renderCpuTime = 0.0f;                 /* ms, render thread work of the frame */
+    int latencyFrames = 0;                      /* frames between the camera sample and the drawn list */
+    float latencyTime = 0.0f;                   /* ms */
+    float uploadProgress = 1.0f;                /* share of the model resident on the GPU */
+    int buildLevelCount = 0;                    /* levels of the hierarchy built in the background, 0 when drawn */
+    int builtLevels = 0;
+    size_t capturedCount = 0;                   /* frames read back for the screenshots and the recording */
+    size_t captureStallCount = 0;               /* captures that waited for the GPU or the writers */
+    size_t captureDroppedCount = 0;             /* captures whose readback could not be mapped */
+    FrameStats *frameStats = NULL;              /* frame breakdown, owned by the render loop */
+    size_t gpuSkippedCount = 0;                 /* frames the GPU timer ring was full */
+    GlCallCounters glCalls;                     /* GL calls of the last frame */
+    int plotMetric = SC_METRIC_FRAME;           /* metric of the breakdown plots */
+    int telemetryFormat = 0;                    /* exported data: 0 telemetry.csv, 1 telemetry.json */
     
     bool isMultiReso = true;        /* Rendering HLOD model*/
     bool isBBXVis = false;          /* Draw boudingbox */
@@ -32,10 +53,14 @@ struct ImguiLayer
     bool isCubeColor = false;       /* Draw color for different cubes */
     bool isAdaptiveLOD = true;      /* Rendering HLOD with vertex interpolation */
     bool isSavePic = false;         /* Save the current rendering result */
+    bool isRecordFrames = false;    /* Save every frame */
     bool VSync = false;             /* Vsync */
     bool isFrustumCulling = true;   /* Frustum Culling */
+    bool isOcclusionCulling = false;/* CPU occlusion culling */
     bool isSoomthShading = false;   /* Smooth shadering*/
     bool isRecordData = false;      /* Output data*/
+    bool isTriangleBudget = false;  /* Select the cubes under a triangle budget */
+    bool isPipelined = true;        /* Select on a thread while the previous selection is drawn */
     
     ImguiLayer();
     ~ImguiLayer();
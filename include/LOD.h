@@ -3,6 +3,7 @@
 #include <map>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 #include <string.h>
 #include "Cube.h"
 #include "Utils.h"
@@ -15,16 +16,19 @@ using namespace std;
 
 struct Cube;
 static constexpr short SC_MAX_LOD_LEVEL = 10;
+static constexpr short SC_MIN_LOD_LEVEL = 2;       /* cubes above this level are always subdivided */
 
 struct LOD
 {
     unordered_map<uint64_t, Cube> cubeTable;       /* hashmap between coord and cell*/
+    vector<Cube *> cubeArray;                      /* cubes grouped by parent, the children of a cube are contiguous */
     size_t totalTriCount = 0;
     size_t totalVertCount = 0;
     int level;                                     /* level*/
     int lodSize;                                   /* grid size 1 << L */ 
     float step;
     float cubeLength;
+    float maxError = 0.0f;                         /* max simplification error of the cubes */
 
     LOD() {}
     LOD(int l);
@@ -1,16 +1,41 @@
 #pragma once
 #include <fstream>
+#include <algorithm>
 #include <pthread.h>
+#include <atomic>
 #include "HLOD.h"
 
+/* Simplifier of a level: quadric edge collapse, or vertex clustering for the coarse levels where the
+ * geometry is small on screen. Both keep the vertices of the block borders */
+enum SimplifyPolicy
+{
+    SC_SIMPLIFY_QUADRIC,
+    SC_SIMPLIFY_CLUSTER
+};
+
+static constexpr int SC_CLUSTER_DEPTH = 3;      /* levels coarser than this depth are built by vertex clustering */
+static constexpr int SC_CLUSTER_MAX_GRID = 1024;     /* cells per axis of a block */
+static constexpr int SC_CLUSTER_PASSES = 5;          /* grid resolutions tried to reach the target */
+static constexpr int SC_BLOCK_SPLIT_SHARE = 2;       /* blocks over 1 / (threads * share) of the level indices are split, 0 for none */
+
+/* Data size of one block, accumulated from its occupied cubes */
+struct BlockCounts
+{
+    unsigned boxCount = 0;
+    size_t idxCount = 0;
+    size_t vertexCount = 0;
+    unsigned short width = 0;              /* cubes per axis, below the block width once split */
+};
+
 /* Block structure for mesh simplification and parent cube construction */
 struct Block
 {
     size_t maxIdxCount;
     size_t maxVertexCount;
-    Boxcoord *list;                        /* valid block list */
+    Boxcoord *list;                        /* valid block list, the largest blocks first */
+    BlockCounts *counts;                   /* data size of each block of the list */
     unsigned int maxBoxCount;
-    unsigned short validBoxCount;          /* valid box count */
+    unsigned int validBoxCount;            /* valid box count */
     unsigned short width;                  /* block width */
 };
 
@@ -22,21 +47,48 @@ struct Parameter
     Block *parentBlks;
     int curLevel;
     float targetError;
+    SimplifyPolicy policy;
+    unordered_map<uint64_t, Cube *> *coarseLeaves;    /* leaf cubes of the coarser levels, key with level bits */
+    const std::atomic<bool> *isCancelled;               /* the workers take no more blocks once set, may be NULL */
 };
 
 unsigned ComputeMaxCounts(HLOD *hlod, int curLevel, Block *blk);
 
+/* Split the blocks holding more than their share of the level in octants, their borders locked like the block
+ * borders, until they fit or a split plane would be locked at the next or the previous level too (blocks of the
+ * default width are never split). Keeps the blocks sorted, returns the max box count */
+unsigned SplitHotBlocks(HLOD *hlod, int curLevel, Block *blk);
+
 size_t RemapIndexBufferSkipDegenerate(uint32_t *indices, size_t index_count, const uint32_t *remap);
 
+/* Grid vertex clustering with the interface of meshopt_simplify_mod: the grid is sized to reach the target
+ * index count, each cell collapses to its vertex of least quadric error. The open border vertices near the
+ * faces of the block box (extent, offset) and the locked vertices stay, the error has the scale of the quadric one */
+size_t ClusterSimplify(uint32_t *destination, uint32_t *simplificationRemap, const uint32_t *indices, size_t idxCount,
+                       const float *positions, size_t vertexCount, size_t targetIdxCount, float *resultError,
+                       float extent, float offset[3], const unsigned char *vertexLock);
+
+unsigned LockLeafBorderVertices(Parameter &arg, Boxcoord &blkCoord, int width, float *positions, size_t vertexCount, unsigned char *vertexLock);
+
 void UpdateVertexParents(void *parents, void *unique_parents, size_t vertex_count, size_t unique_vertex_count,
                          int vertex_stride, uint32_t *grid_remap, uint32_t *simplification_remap);
 
-unsigned LoadBlockData(HLOD *hlod, Boxcoord &bottom, int width, int curLevel, unordered_map<uint64_t, pair<size_t, size_t>> &cubeTable, Mesh *destination, bool isGetData);
+unsigned LoadBlockData(HLOD *hlod, Boxcoord &bottom, int curLevel, int width, unordered_map<uint64_t, pair<size_t, size_t>> &cubeTable, Mesh *destination, bool isGetData);
 
 unsigned LoadChildData(HLOD *hlod, Mesh *blkData, uint64_t *cubeList, Boxcoord &bottom, int curLevel, unordered_map<uint64_t, pair<size_t, size_t>> &cubeTable, Mesh *destination);
 
 void InitParentMeshGrid(LOD *pmg, LOD *mg);
 
-void LODConstructor(HLOD *hlod, int curLevel, int width, float targetError);
+void LODConstructor(HLOD *hlod, int curLevel, int width, float targetError, SimplifyPolicy policy = SC_SIMPLIFY_QUADRIC,
+                    const std::atomic<bool> *isCancelled = NULL);
+
+/* blockWidth: cubes per axis of a simplification block, even and at least SC_BLOCK_SIZE,
+ * clusterDepth: the levels coarser than this depth are built by vertex clustering, 0 for none,
+ * builtLevels: counts the finished levels for a progress display,
+ * isCancelled: stops the build between two blocks, the hierarchy is left incomplete; returns false if it was */
+bool HLODConsructor(HLOD *hlod, int maxLevel, float targetError, int blockWidth = SC_BLOCK_SIZE, int clusterDepth = SC_CLUSTER_DEPTH,
+                    std::atomic<int> *builtLevels = NULL, const std::atomic<bool> *isCancelled = NULL);
 
-void HLODConsructor(HLOD *hlod, int maxLevel, float targetError);
\ No newline at end of file
+/* Times meshopt_simplify_mod on the blocks of the leaf level with the scalar and the SIMD quadric code,
+ * and checks that both give the same result */
+void BenchmarkSimplification(HLOD *hlod, int width, float targetError);
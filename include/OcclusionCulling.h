@@ -0,0 +1,66 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include <pthread.h>
+#include "HLOD.h"
+#include "RenderList.h"
+
+using namespace std;
+
+/* Software occlusion culling parameters */
+static constexpr int SC_OCC_WIDTH = 256;                /* depth buffer resolution, powers of two */
+static constexpr int SC_OCC_HEIGHT = 128;
+static constexpr int SC_OCC_THREADS = 4;                /* one horizontal band of the depth buffer per thread */
+static constexpr int SC_OCC_LEVEL_UP = 2;               /* the occluder of a selected cube is its ancestor this many levels up */
+static constexpr size_t SC_OCC_TRI_BUDGET = 1 << 15;    /* max occluder triangles per frame */
+static constexpr int SC_OCC_MAX_PYRAMID = 16;
+
+struct OcclusionCuller;
+
+/* Band of the depth buffer of a rasterizer thread */
+struct RasterBand
+{
+    OcclusionCuller *culler;
+    int y0, y1;
+};
+
+/* CPU depth rasterizer and hierarchical Z test of the selected cubes */
+struct OcclusionCuller
+{
+    float *pyramid[SC_OCC_MAX_PYRAMID]{};   /* level 0 the depth buffer, level k the max depth of 2x2 texels of level k - 1 */
+    int pyramidWidth[SC_OCC_MAX_PYRAMID];
+    int pyramidHeight[SC_OCC_MAX_PYRAMID];
+    int pyramidLevels = 0;
+    vector<float> screenTris;               /* occluder triangles in screen space: x, y, z for 3 vertices */
+    vector<float> clipVerts;                /* clip coordinates of the vertices of the current occluder cube */
+    vector<float> screenVerts;              /* their screen position and depth, valid in front of the near plane */
+    vector<unsigned> occluderStamps[SC_MAX_LOD_LEVEL];   /* per cube array: frame the cube was last taken as an occluder */
+    unsigned occluderStamp = 0;
+    size_t occluderTriCount = 0;
+    size_t culledCount = 0;
+    float nearPlane = 0.0f;                 /* clip w of the camera near plane */
+
+    /* Rasterizer threads of the bands 1 to SC_OCC_THREADS - 1, kept for the whole run; Cull rasterizes band 0 */
+    RasterBand bands[SC_OCC_THREADS];
+    pthread_t rasterizers[SC_OCC_THREADS];
+    pthread_mutex_t rasterMutex;
+    pthread_cond_t startCond;               /* a new depth buffer is started or the threads stop */
+    pthread_cond_t doneCond;                /* a band is rasterized */
+    unsigned rasterFrame = 0;               /* depth buffers started */
+    int pendingBands = 0;
+    bool isRunning = true;
+
+    OcclusionCuller();
+    ~OcclusionCuller();
+
+    /* Rasterize the occluders of the nearest cubes, then remove the hidden cubes of the list sorted front to back,
+     * return the culled count. pvm: object to clip matrix, eye: viewpoint in object space, nearClip: clip w of the camera near plane */
+    size_t Cull(HLOD &hlod, int maxLevel, RenderList &list, const float *pvm, const float *eye, float nearClip);
+    /* Screen space triangles of an occluder cube, pushed back by its error and clipped at the near plane */
+    void AddOccluder(HLOD &hlod, Cube &cube, const float *pvm, const float *eye);
+    void AddTriangle(const float *a, const float *b, const float *c);
+    void RasterizeBand(int y0, int y1);
+    void *RasterizeLoop(RasterBand *band);
+    void BuildPyramid();
+    bool IsOccluded(Cube &cube, const float *pvm);
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include <atomic>
+#include <pthread.h>
+#include "HLOD.h"
+#include "ModelRead.h"
+
+static constexpr size_t SC_PROXY_TRIANGLES = 1 << 17;      /* triangles of the model drawn during the build */
+
+/* Multi-resolution model built on a background thread. The levels are built from the finest one up and
+ * the hierarchy can only be traversed from its root, so the renderer takes it as a whole once isReady
+ * is set; builtLevels only reports the progress */
+struct ProgressiveBuild
+{
+    ModelReader *reader;                    /* input, released by the build */
+    HLOD *hlod;
+    int maxLevel;                           /* requested depth, the built one once ready */
+    float errorThreshold;
+    int blockWidth;
+    int clusterDepth;
+    bool isAdaptive;
+    pthread_t thread;
+    bool isStarted = false;
+    bool isTaken = false;                   /* render thread only */
+    std::atomic<int> builtLevels{0};        /* finished levels, the finest one included */
+    std::atomic<int> levelCount{0};         /* levels to build, known once the finest one is */
+    std::atomic<bool> isReady{false};       /* release: hlod and maxLevel are complete */
+    std::atomic<bool> isCancelled{false};   /* the build stops after the current block, never ready */
+
+    /* Build on the calling thread */
+    void Run();
+    void Start();
+    /* The hierarchy the first time it is ready, NULL otherwise */
+    HLOD *Acquire();
+    /* Stop an unfinished build, its hierarchy is left incomplete */
+    void Cancel();
+    /* Wait for the build thread, finished or cancelled */
+    void Join();
+};
+
+/* Single cube hierarchy of a vertex clustering of the input, drawn while the full one is built */
+void BuildProxy(ModelReader *reader, HLOD &proxy, size_t targetTriCount);
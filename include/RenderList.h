@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <stdint.h>
+#include "LOD.h"
+
+using namespace std;
+
+/* Draw parameters of a selected cube, resolved once at selection time */
+struct DrawRecord
+{
+    Cube *cube;                 /* bounds and bounding box */
+    size_t idxByteOffset;       /* first index of the cube in the GPU index stream */
+    int indexSize;              /* 2 or 4 bytes */
+    size_t vertexOffset;        /* base vertex of the cube */
+    size_t parentBase;          /* first vertex of the parent cube */
+    int triangleCount;
+    int level;
+    int lodIdx;                 /* index in the LOD array */
+    float distance;             /* to the viewpoint, sort key */
+};
+
+/* Flat list of the cubes to draw, its storage is reused from frame to frame */
+struct RenderList
+{
+    vector<DrawRecord> records;
+    size_t triangleCount = 0;
+
+    /* State of the selection the list was made with */
+    Vec3 viewpoint;                         /* the vertices morph from this viewpoint */
+    float kappa[SC_MAX_LOD_LEVEL]{};        /* distance factors, budget scale applied */
+    float budgetScale = 1.0f;
+    size_t occludedCount = 0;
+    size_t occluderTriCount = 0;
+    float occlusionTime = 0.0f;             /* ms */
+    float selectionTime = 0.0f;             /* ms, occlusion culling included */
+    float listTime = 0.0f;                  /* ms, sort and occlusion culling of the list */
+    int frame = 0;                          /* render frame the camera was sampled at */
+    double sampleTime = 0.0;                /* s, time of the camera sample */
+
+    void Clear();
+    void Push(LOD *meshbook[], int lodIdx, Cube &cube, float distance);
+    /* Nearest cubes first, the early depth test rejects the hidden fragments of the farther ones */
+    void SortFrontToBack();
+};
+
+/* Triple buffer of render lists between the selection thread and the render thread, no lock on either side */
+struct RenderListExchange
+{
+    RenderList lists[3];
+    RenderList *back = &lists[0];           /* filled by the selection */
+    RenderList *front = &lists[1];          /* drawn by the render thread */
+    atomic<uintptr_t> middle;               /* last published list, low bit set until the render thread takes it */
+
+    RenderListExchange() : middle((uintptr_t)&lists[2]) {}
+    /* Selection side: hand over the back list and continue with the list given back */
+    void Publish();
+    /* Render side: take the newest list if one was published since the last call */
+    bool Acquire();
+};
@@ -5,8 +5,10 @@
 #include <math/vec3.h>
 #include <math/vec4.h>
 #include <math/mat4.h>
+#include "GlState.h"
 
 #include <string>
+#include <unordered_map>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -15,6 +17,7 @@ class Shader
 {
 public:
     unsigned int ID;
+    std::unordered_map<std::string, GLint> uniformLocations;   /* default block uniforms, resolved once linked */
     Shader() {}
     void Build(const char *vertexPath, const char *fragmentPath, const char *geometryPath = nullptr)
     {
@@ -56,6 +59,15 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        BuildSource(vertexCode, fragmentCode, geometryCode);
+    }
+
+    /* Compile and link the program from source code, no geometry shader if geometryCode is empty.
+     * isRetrievable keeps the binary of the program available to glGetProgramBinary */
+    void BuildSource(const std::string &vertexCode, const std::string &fragmentCode, const std::string &geometryCode = "",
+                     bool isRetrievable = false)
+    {
+        bool hasGeometry = !geometryCode.empty();
         const char *vShaderCode = vertexCode.c_str();
         const char *fShaderCode = fragmentCode.c_str();
 
@@ -76,7 +88,7 @@ public:
 
         /* If geometry shader is given, compile geometry shader */
         unsigned int geometry;
-        if (geometryPath != nullptr)
+        if (hasGeometry)
         {
             const char *gShaderCode = geometryCode.c_str();
             geometry = glCreateShader(GL_GEOMETRY_SHADER);
@@ -89,102 +101,169 @@ public:
         ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
-        if (geometryPath != nullptr)
+        if (hasGeometry)
             glAttachShader(ID, geometry);
+        if (isRetrievable)
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(ID);
         CheckCompileErrors(ID, "PROGRAM");
+        ResolveUniforms();
         /* Delete the shader */
         glDeleteShader(vertex);
         glDeleteShader(fragment);
-        if (geometryPath != nullptr)
+        if (hasGeometry)
             glDeleteShader(geometry);
     }
 
+    /* Look up the locations of the active uniforms, an array also under its name without "[0]" */
+    void ResolveUniforms()
+    {
+        uniformLocations.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(maxLength + 1, '\0');
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+            std::string uniform = name.substr(0, length);
+            GLint location = glGetUniformLocation(ID, uniform.c_str());
+            if (location < 0)
+            {
+                continue;   /* member of a uniform block */
+            }
+            uniformLocations[uniform] = location;
+            if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0)
+            {
+                uniformLocations[uniform.substr(0, uniform.size() - 3)] = location;
+            }
+        }
+    }
+
+    /* -1 for a uniform the program does not use, the glUniform calls ignore it */
+    GLint Location(const std::string &name) const
+    {
+        auto it = uniformLocations.find(name);
+        return it == uniformLocations.end() ? -1 : it->second;
+    }
+
     /* Activate the shader */
     void Use()
     {
-        glUseProgram(ID);
+        glState.UseProgram(ID);
+    }
+
+    /* Uniforms by location, for the calls repeated per draw */
+    void SetIVec4(GLint location, int x, int y, int z, int w) const
+    {
+        glUniform4i(location, x, y, z, w);
+        glState.CountUniform();
     }
 
     /* Utility uniform functions */
     void SetBool(const std::string &name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(Location(name), (int)value);
+        glState.CountUniform();
     }
 
     void SetInt(const std::string &name, size_t value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(Location(name), value);
+        glState.CountUniform();
     }
 
     void SetFloat(const std::string &name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(Location(name), value);
+        glState.CountUniform();
+    }
+
+    void SetFloatArray(const std::string &name, const float *value, int count) const
+    {
+        glUniform1fv(Location(name), count, value);
+        glState.CountUniform();
     }
 
     void SetVec2(const std::string &name, const glm::vec2 &value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(Location(name), 1, &value[0]);
+        glState.CountUniform();
     }
 
     void SetVec2(const std::string &name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(Location(name), x, y);
+        glState.CountUniform();
     }
 
     void SetVec2(const std::string &name, float *value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(Location(name), 1, &value[0]);
+        glState.CountUniform();
     }
 
     void SetVec3(const std::string &name, const glm::vec3 &value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(Location(name), 1, &value[0]);
+        glState.CountUniform();
     }
 
     void SetVec3(const std::string &name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(Location(name), x, y, z);
+        glState.CountUniform();
     }
 
     void SetVec3(const std::string &name, const Vec3 &value) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), value.x, value.y, value.z);
+        glUniform3f(Location(name), value.x, value.y, value.z);
+        glState.CountUniform();
     }
 
     void SetVec4(const std::string &name, const Vec4 value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(Location(name), 1, &value[0]);
+        glState.CountUniform();
     }
 
     void SetVec4(const std::string &name, float x, float y, float z, float w)
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(Location(name), x, y, z, w);
+        glState.CountUniform();
     }
 
     void SetVec4(const std::string &name, const glm::vec4 &value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(Location(name), 1, &value[0]);
+        glState.CountUniform();
     }
 
     void SetMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(Location(name), 1, GL_FALSE, &mat[0][0]);
+        glState.CountUniform();
     }
 
     void SetMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(Location(name), 1, GL_FALSE, &mat[0][0]);
+        glState.CountUniform();
     }
 
     void SetMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(Location(name), 1, GL_FALSE, &mat[0][0]);
+        glState.CountUniform();
     }
 
     void SetMat4(const std::string &name, const Mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &(mat.cols[0][0]));
+        glUniformMatrix4fv(Location(name), 1, GL_FALSE, &(mat.cols[0][0]));
+        glState.CountUniform();
     }
 
 private:
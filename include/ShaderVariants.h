@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include "Shader.h"
+
+using namespace std;
+
+/* Feature bits of the default shader, each one a #define of the same name without the prefix */
+static constexpr unsigned SC_SHADER_ADAPTIVE = 1 << 0;          /* morph to the parent vertices */
+static constexpr unsigned SC_SHADER_SMOOTH_SHADING = 1 << 1;    /* interpolated normals, else flat shading */
+static constexpr unsigned SC_SHADER_LOD_COLOR = 1 << 2;         /* colour by level, takes over CUBE_COLOR */
+static constexpr unsigned SC_SHADER_CUBE_COLOR = 1 << 3;        /* colour by cube */
+static constexpr int SC_SHADER_FEATURES = 4;
+static constexpr int SC_SHADER_VARIANTS = 1 << SC_SHADER_FEATURES;
+
+/* Programs specialised at compile time from one vertex and fragment source, compiled on first use and
+ * kept on disk as program binaries so the next start only has to load them */
+struct ShaderVariants
+{
+    string vertexCode;
+    string fragmentCode;
+    string defines;                                 /* injected in every variant, e.g. the vertex layout */
+    string cachePrefix;                             /* program binary files: prefix + features + ".bin" */
+    Shader *programs[SC_SHADER_VARIANTS]{};
+    int loadedCount = 0;                            /* programs read from the binary cache */
+    int compiledCount = 0;
+
+    /* Read the sources, cacheDir empty to disable the binary cache */
+    bool Load(const string &vertexPath, const string &fragmentPath, const string &cacheDir);
+    /* Program of a feature set, built on first request */
+    Shader *Get(unsigned features);
+    void Destroy();
+
+    /* Source with the defines of the features after its #version line */
+    string Inject(const string &code, unsigned features);
+    bool LoadBinary(Shader *program, const string &file, uint64_t key);
+    void SaveBinary(Shader *program, const string &file, uint64_t key);
+};
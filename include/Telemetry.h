@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+using namespace std;
+
+static constexpr int SC_TELEMETRY_COLUMNS = 16;         /* values of a row at most */
+static constexpr size_t SC_TELEMETRY_BATCH = 64;        /* rows queued before the writer is woken */
+static constexpr size_t SC_TELEMETRY_BUFFER = 1 << 20;  /* stdio buffer of the file */
+
+struct TelemetryRow
+{
+    double values[SC_TELEMETRY_COLUMNS];
+};
+
+/* Per frame values streamed to a CSV file, or a JSON array of objects when the file ends with .json.
+ * The render thread only queues the rows, a writer thread formats them in batches */
+struct TelemetryWriter
+{
+    FILE *file = NULL;
+    bool isJson = false;
+    vector<string> columns;
+    pthread_t writer;
+    pthread_mutex_t mutex;
+    pthread_cond_t rowCond;                 /* a batch is queued or the writer stops */
+    vector<TelemetryRow> rows;              /* queued, swapped out by the writer */
+    size_t writtenCount = 0;                /* rows written, the writer's */
+    bool isRunning = false;
+
+    bool Open(const string &fileName, const vector<string> &columnNames);
+    /* Queue a row of columns.size() values */
+    void Push(const double *values);
+    /* Write the queued rows and close the file */
+    void Close();
+    bool IsOpen() const { return isRunning; }
+
+    void *WriteLoop();
+    void WriteRows(const vector<TelemetryRow> &batch);
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+/* Zone tracing of the build and render threads, written as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+ * Compiled in with SC_TRACE (make TRACE=1), the macros expand to nothing otherwise */
+
+static constexpr size_t SC_TRACE_CHUNK_EVENTS = 4096;   /* events of one allocation of a thread buffer */
+static constexpr size_t SC_TRACE_MAX_CHUNKS = 1024;     /* per thread buffer, later events are dropped */
+
+#ifdef SC_TRACE
+
+/* Scope timed from construction to destruction, or to End */
+struct TraceZone
+{
+    const char *name;
+    const char *argName;
+    int64_t value;
+    uint64_t start;
+
+    TraceZone(const char *zoneName, const char *zoneArgName = NULL, int64_t zoneValue = 0);
+    ~TraceZone();
+    void End();
+};
+
+/* Name the calling thread in the trace, threads of the same name reuse the buffers of the finished ones */
+void TraceThreadName(const char *name);
+
+#define SC_TRACE_CONCAT_(a, b) a##b
+#define SC_TRACE_CONCAT(a, b) SC_TRACE_CONCAT_(a, b)
+#define SC_TRACE_ZONE(name) TraceZone SC_TRACE_CONCAT(traceZone, __LINE__)(name)
+#define SC_TRACE_ZONE_ARG(name, argName, value) TraceZone SC_TRACE_CONCAT(traceZone, __LINE__)(name, argName, value)
+#define SC_TRACE_BEGIN(zone, name) TraceZone zone(name)
+#define SC_TRACE_END(zone) zone.End()
+#define SC_TRACE_THREAD(name) TraceThreadName(name)
+
+#else
+
+#define SC_TRACE_ZONE(name)
+#define SC_TRACE_ZONE_ARG(name, argName, value)
+#define SC_TRACE_BEGIN(zone, name)
+#define SC_TRACE_END(zone)
+#define SC_TRACE_THREAD(name)
+
+#endif
+
+/* Write the events recorded so far, safe while the traced threads run; false if tracing is compiled out */
+bool TraceWrite(const string &file);
@@ -11,9 +11,20 @@ constexpr int VERTEX_STRIDE = 3 * sizeof(float);        /* vertex stride */
 constexpr int UV_STRIDE = 2 * sizeof(float);            /* uv stride */
 constexpr int COLOR_STRIDE = 3 * sizeof(unsigned char); /* color stride*/
 
-/* Mesh simplification block size */
+/* Interleaved vertex of the SC_INTERLEAVED_VERTEX layout, the morph target baked in: 32 bytes read at once
+ * instead of the position, normal and parent index plus six scattered parent reads */
+struct MorphVertex
+{
+    float position[3];
+    uint32_t normal;                /* snorm 2_10_10_10, w unused */
+    float parentPosition[3];
+    uint32_t parentNormal;
+};
+static_assert(sizeof(MorphVertex) == 32, "MorphVertex is expected to be 32 bytes");
+
+/* Mesh simplification block size (default, runtime width in HLODConsructor) */
 constexpr int SC_BLOCK_SIZE = 4;
-constexpr int SC_COORD_CONVERT = 2; /* half of SC_BLOCK_SIZE*/
+constexpr int SC_COORD_CONVERT = 2; /* block offset, half of SC_BLOCK_SIZE*/
 
 /* Input mesh model attribute */
 struct ModelAttributesStatus
@@ -108,6 +119,21 @@ inline void Float2Int(float p[3], int coord[3], float bottom[3], float step)
     }
 }
 
+/* Pack the cube coord into the key of the cube table, 16 bits per axis */
+inline uint64_t PackCoord(int x, int y, int z)
+{
+    return (uint64_t)(x) | ((uint64_t)(y) << 16) | ((uint64_t)(z) << 32);
+}
+
+/* Key of the ancestor cube shift levels above, the level bits (48-63) are dropped */
+inline uint64_t AncestorCoord(uint64_t coord64, int shift)
+{
+    uint64_t x = (coord64 & 0xFFFF) >> shift;
+    uint64_t y = ((coord64 >> 16) & 0xFFFF) >> shift;
+    uint64_t z = ((coord64 >> 32) & 0xFFFF) >> shift;
+    return x | (y << 16) | (z << 32);
+}
+
 /* Convert the coord coordinate based on the block size */
 inline bool ConvertBlockCoordinates(Boxcoord &temp, Boxcoord &result, int block_width, int lodSize)
 {
@@ -40,6 +40,7 @@ struct Viewer
 	int height;
 	uint32_t navMode = NavMode::Orbit;  /* Mode */
 	bool isFreezeFrame = false;          /* freeze the frame */
+	bool isRecordPath = false;           /* record the camera of each frame */
 	bool isMousePressed = false;
 
 	Viewer();
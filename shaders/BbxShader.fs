@@ -1,6 +1,18 @@
-#version 460 core
+#version 430 core
+flat in int boxLevel;
 out vec4 outColor;
 
+const ivec3 levelColors[8] = {
+	{120,28,129},
+	{64,67,153},
+	{72,139,194},
+	{107,178,140},
+	{159,190,87},
+	{210,179,63},
+	{231,126,49},
+	{217,33,32}
+};
+
 void main(){
-    outColor = vec4(0.0f, 1.0f, 0.0f, 1.0f);
-}
\ No newline at end of file
+    outColor = vec4(vec3(levelColors[boxLevel % 8]) / 255.0f, 1.0f);
+}
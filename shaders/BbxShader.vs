@@ -1,6 +1,7 @@
-#version 460 core 
+#version 430 core 
 layout (location = 0) in vec3 pos; 
-
+layout (location = 1) in vec4 box;      /* bottom corner, length */
+layout (location = 2) in int level;
 
 layout (std140, binding = 0) uniform Matrices
 {
@@ -9,6 +10,9 @@ layout (std140, binding = 0) uniform Matrices
     mat4 model;
 } matrices;
 
+flat out int boxLevel;
+
 void main(){
-    gl_Position = matrices.projection * matrices.view * matrices.model * vec4(pos, 1.0);
+    boxLevel = level;
+    gl_Position = matrices.projection * matrices.view * matrices.model * vec4(box.xyz + pos * box.w, 1.0);
 }
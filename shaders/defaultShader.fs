@@ -1,20 +1,22 @@
 #version 430 core
+/* Feature defines injected by ShaderVariants: SMOOTH_SHADING, LOD_COLOR, CUBE_COLOR */
 layout (location = 0) in vec3 nml;
 layout (location = 1) in vec2 texCoord;
 layout (location = 2) in vec3 lightPos;
 layout (location = 3) in vec3 viewDir;
 layout (location = 5) in float lambda;
 
-uniform int level;
-uniform int maxLevel;
-uniform int coordX;
-uniform int coordY;
-uniform int coordZ;
+layout (std140, binding = 1) uniform FrameParameters{
+    vec3 vp;
+    float sigma;
+    vec3 freezeVp;
+    int maxLevel;
+    float kappa[10];
+} params;
+
+uniform ivec4 cube;             /* level, parent base, colour index */
 uniform bool textureExist;
 uniform bool colorExist;
-uniform bool isCubeColorized;
-uniform bool isSmoothShading;
-uniform bool isLodColorized;
 
 out vec4 outColor;
 
@@ -49,14 +51,14 @@ void main(){
     vec3 normal;
     
     /* Smooth shading */
-    if(isSmoothShading){
-        normal = normalize(nml);
-        if(dot(view, normal) < 0.0f)
-            normal = -normal;
-    }
-    else{ /* Flat shading */
-        normal = normalize(cross(dFdx(viewDir), dFdy(viewDir)));
-    }
+#ifdef SMOOTH_SHADING
+    normal = normalize(nml);
+    if(dot(view, normal) < 0.0f)
+        normal = -normal;
+#else
+    /* Flat shading */
+    normal = normalize(cross(dFdx(viewDir), dFdy(viewDir)));
+#endif
 
     float Id = max(dot(normal, light), 0.0f);
     vec3 diffuse = Kd * DIFFUSE_COLOR * Id;
@@ -70,8 +72,9 @@ void main(){
     vec3 specular = Ks * SPECULAR_COLOR * Is;
     vec3 full = vec3(0.0f);
     
-    if(isLodColorized){
-        float l = maxLevel - level + (1.0f - lambda);
+#if defined(LOD_COLOR)
+    {
+        float l = params.maxLevel - cube.x + (1.0f - lambda);
         vec3 c = vec3(0.0f);
         if (l < 1){
             c.r = 1.0f - l;
@@ -88,14 +91,13 @@ void main(){
 
         outColor = vec4((ambient + diffuse + specular) * c , 1.0f);
     }
-    else if(isCubeColorized){
-        int idx = 31 * level + 7 * coordX + 13 * coordY + 17 * coordZ;
-        idx = idx & 7;
-        vec3 c = vec3(cubeColors[idx]) / 255.f;
+#elif defined(CUBE_COLOR)
+    {
+        vec3 c = vec3(cubeColors[cube.z]) / 255.f;
         outColor = vec4((ambient + diffuse + specular) * c , 1.0f);  
     }
-    else{
-        outColor = vec4((ambient + diffuse + specular) * defaultColor , 1.0f);
-    }
+#else
+    outColor = vec4((ambient + diffuse + specular) * defaultColor , 1.0f);
+#endif
     
 }
\ No newline at end of file
@@ -1,11 +1,19 @@
 #version 430 core
+/* Feature defines injected by ShaderVariants: ADAPTIVE morphs the vertices to their parent position,
+ * INTERLEAVED_VERTEX reads the parent from the vertex record instead of the storage buffers */
+
 /* In variables */
 layout (location = 0) in vec3 pos;
 layout (location = 1) in vec3 normal;
+#ifdef INTERLEAVED_VERTEX
+layout (location = 6) in vec3 parentPosition;
+layout (location = 7) in vec3 parentNormal;
+#else
 layout (location = 2) in int idx;
 
 layout(std430, binding = 0) restrict readonly buffer positions {float parentPos[];};
 layout(std430, binding = 1) restrict readonly buffer normals {float parentNormal[];};
+#endif
 
 layout (std140, binding = 0) uniform Matrices{
     mat4 projection;
@@ -13,20 +21,17 @@ layout (std140, binding = 0) uniform Matrices{
     mat4 model;
 } matrices;
 
-struct AdaptiveParameters{
-    float kappa;
-    float sigma;
+/* Parameters of the frame, written once per frame (FrameParameters in Display.h) */
+layout (std140, binding = 1) uniform FrameParameters{
     vec3 vp;
-    vec3 freezeVp;
-    bool isFreezeFrame;
-    bool isAdaptive;
-};
-
-uniform AdaptiveParameters params;
+    float sigma;
+    vec3 freezeVp;              /* viewpoint the drawn cubes were selected at */
+    int maxLevel;
+    float kappa[10];            /* distance factor of each level from the screen-space error, SC_MAX_LOD_LEVEL entries */
+} params;
 
-/* Base index for the ssbo */
-uniform int level;
-uniform int parentBase;
+/* Per draw, one call: level, base index of the parent vertices in the ssbo, colour index of the cube */
+uniform ivec4 cube;
 
 /* Out to fragment shader*/
 layout (location = 0) out vec3 nml;
@@ -43,32 +48,37 @@ float ComputeDistance(vec3 vp, vec3 vert){
     return maxDis;
 }
 
-float ComputeLambda(int level, float kappa, float dis){
-    float minDis = (1 + kappa + params.sigma) / (1 << level); 
-    float maxDis = (kappa - params.sigma) / (1 << (level - 1));
+float ComputeLambda(int level, float dis){
+    if(level == 0){
+        return 1.0f;
+    }
+
+    float minDis = (1 + params.kappa[level] + params.sigma) / (1 << level); 
+    float maxDis = (params.kappa[level - 1] - params.sigma) / (1 << (level - 1));
     
     return clamp((maxDis - dis) / (maxDis - minDis), 0.0f, 1.0f);
 }
 
 void main(){    
-    float dis;
-    if(params.isFreezeFrame){
-        dis = ComputeDistance(params.freezeVp, pos);
-    }
-    else{
-        dis = ComputeDistance(params.vp, pos);
-    }
-
     lambda = 1.0f;
     vec4 gl = vec4(pos, 1.0f);
     nml = normal;
-    if(params.isAdaptive){
-        uint p = 3 * (idx + parentBase);
-        lambda = ComputeLambda(level, params.kappa, dis);
+#ifdef ADAPTIVE
+    /* Morph from the selection viewpoint so the cubes of the list stay crack free */
+    float dis = ComputeDistance(params.freezeVp, pos);
+    lambda = ComputeLambda(cube.x, dis);
+#ifdef INTERLEAVED_VERTEX
+    vec3 morphPos = parentPosition;
+    vec3 morphNormal = parentNormal;
+#else
+    uint p = 3 * (idx + cube.y);
+    vec3 morphPos = vec3(parentPos[p], parentPos[p + 1], parentPos[p + 2]);
+    vec3 morphNormal = vec3(parentNormal[p], parentNormal[p + 1], parentNormal[p + 2]);
+#endif
 
-        gl = lambda * vec4(pos, 1.0) + (1 - lambda) * vec4(parentPos[p], parentPos[p + 1], parentPos[p + 2], 1.0);
-        nml = lambda * normal + (1 - lambda) * vec3(parentNormal[p], parentNormal[p + 1], parentNormal[p + 2]);
-    }   
+    gl = lambda * vec4(pos, 1.0) + (1 - lambda) * vec4(morphPos, 1.0);
+    nml = lambda * normal + (1 - lambda) * morphNormal;
+#endif
    
     gl_Position = matrices.projection * matrices.view * matrices.model * gl;
     
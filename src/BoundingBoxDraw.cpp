@@ -1,85 +1,102 @@
+#include <cstddef>
 #include "BoundingBoxDraw.h"
 
+/*
+    Unit cube corners
+         F----G
+        /|    /|
+        E|---H |
+        | A--|-B
+        |/   |/
+        D----C
+            
+*/
+static constexpr float SC_VERTICES_BBX[24] = {
+    0.0f, 0.0f, 0.0f, // A
+    0.0f, 1.0f, 0.0f, // B
+    1.0f, 1.0f, 0.0f, // C
+    1.0f, 0.0f, 0.0f, // D
+    1.0f, 0.0f, 1.0f, // E
+    0.0f, 0.0f, 1.0f, // F
+    0.0f, 1.0f, 1.0f, // G
+    1.0f, 1.0f, 1.0f  // H
+};
+
 BoundingBoxDraw::BoundingBoxDraw(){}
 
 BoundingBoxDraw::~BoundingBoxDraw() {}
 
-void BoundingBoxDraw::InitBuffer(Cube &cube, float length)
+void BoundingBoxDraw::InitBuffer()
 {
-    /* Compute the verteices of Cube */
-    cube.CalculateBBXVertex(length);
-
     glGenVertexArrays(1, &bbxVAO);
     glGenBuffers(1, &bbxVBO);
     glGenBuffers(1, &bbxEBO);
+    glGenBuffers(1, &instanceVBO);
 
     /* Bind buffer */
-    glBindVertexArray(bbxVAO);
+    glState.BindVertexArray(bbxVAO);
     glBindBuffer(GL_ARRAY_BUFFER, bbxVBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bbxEBO);
-
-    glBufferData(GL_ARRAY_BUFFER, 30 * 1024 * 1024, NULL, GL_DYNAMIC_DRAW);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, 30 * 1024 * 1024, NULL, GL_DYNAMIC_DRAW);
-
+    glBufferData(GL_ARRAY_BUFFER, sizeof(SC_VERTICES_BBX), SC_VERTICES_BBX, GL_STATIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
     glEnableVertexAttribArray(0);
 
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(cube.bbxVertices), cube.bbxVertices);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(SC_INDICES_BBX), SC_INDICES_BBX);
-
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bbxEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(SC_INDICES_BBX), SC_INDICES_BBX, GL_STATIC_DRAW);
+
+    /* One box per instance: bottom and length, then level */
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(BbxInstance), (void *)0);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(1);
+    glVertexAttribIPointer(2, 1, GL_INT, sizeof(BbxInstance), (void *)offsetof(BbxInstance, level));
+    glVertexAttribDivisor(2, 1);
+    glEnableVertexAttribArray(2);
+
+    glState.BindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
-void BoundingBoxDraw::Render(Cube &cube, Shader *bbxShader, float length, int level)
+void BoundingBoxDraw::Render(HLOD &hlod, const RenderList &list, Shader *bbxShader)
 {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    uint64_t ijk_info = (uint64_t)(cube.coord[0]) | ((uint64_t)(cube.coord[1]) << 16) | ((uint64_t)(cube.coord[2]) << 32) | ((uint64_t)(level) << 48);
-    if (vboOffset.count(ijk_info) == 0 && eboOffset.count(ijk_info) == 0)
+    if (list.records.empty())
     {
-        vertexOffset = vertexOffset + 8 * 3 * sizeof(float);
-        idxOffset = idxOffset + 24 * sizeof(uint32_t);
-        vboOffset.insert(make_pair(ijk_info, vertexOffset));
-        eboOffset.insert(make_pair(ijk_info, idxOffset));
+        return;
+    }
 
-        cube.CalculateBBXVertex(length);
-        glBindBuffer(GL_ARRAY_BUFFER, bbxVBO);
-        glBindVertexArray(bbxVAO);
+    instances.resize(list.records.size());
+    for (size_t i = 0; i < list.records.size(); ++i)
+    {
+        const DrawRecord &record = list.records[i];
+        BbxInstance &instance = instances[i];
+        memcpy(instance.bottom, record.cube->bottom, 3 * sizeof(float));
+        instance.length = hlod.lods[record.lodIdx]->cubeLength;
+        instance.level = record.level;
+    }
 
-        glBufferSubData(GL_ARRAY_BUFFER, vertexOffset, sizeof(cube.bbxVertices), cube.bbxVertices);
-        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, idxOffset, sizeof(SC_INDICES_BBX), SC_INDICES_BBX);
+    /* Orphan the storage of the last frame, grow it by doubling */
+    size_t size = instances.size() * sizeof(BbxInstance);
+    if (size > instanceCapacity)
+    {
+        instanceCapacity = max(size, 2 * instanceCapacity);
     }
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, instanceCapacity, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, instances.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     bbxShader->Use();
-    glBindBuffer(GL_ARRAY_BUFFER, bbxVBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bbxEBO);
-    glBindVertexArray(bbxVAO);
-
+    glState.BindVertexArray(bbxVAO);
     glLineWidth(2.0);
-    glDrawElementsBaseVertex(GL_LINES, 24, GL_UNSIGNED_INT, (GLvoid *)(eboOffset[ijk_info]), vboOffset[ijk_info] / (3 * sizeof(float)));
-
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-};
+    glDrawElementsInstanced(GL_LINES, 24, GL_UNSIGNED_INT, (void *)0, instances.size());
+    glState.CountDraw();
+    glState.BindVertexArray(0);
+}
 
-void BoundingBoxDraw::FlushBuffer(Cube &cube)
+void BoundingBoxDraw::Destroy()
 {
-    // bind buffers
-    glBindVertexArray(bbxVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, bbxVBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bbxEBO);
-
-    // allocate the buffer based on the LRU structure
-    glBufferData(GL_ARRAY_BUFFER, 10 * 1024 * 1024, NULL, GL_DYNAMIC_DRAW);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, 10 * 1024 * 1024, NULL, GL_DYNAMIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(cube.bbxVertices), cube.bbxVertices);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(SC_INDICES_BBX), SC_INDICES_BBX);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-}
\ No newline at end of file
+    glDeleteVertexArrays(1, &bbxVAO);
+    glDeleteBuffers(1, &bbxVBO);
+    glDeleteBuffers(1, &bbxEBO);
+    glDeleteBuffers(1, &instanceVBO);
+}
@@ -269,3 +269,30 @@ int is_visible(const Aabb& bbox, const float *pvm){
 	if (clip_R || clip_L || clip_T || clip_B || clip_F || clip_N) return 0;
 	return fully_in ? 2 : 1;
 }
+
+void frustum_planes(const float *pvm, float planes[24]){
+	for (int i = 0; i < 3; ++i) {
+		for (int side = 0; side < 2; ++side) {
+			float sign = side ? -1.f : 1.f;
+			float *p = &planes[4 * (2 * i + side)];
+			p[0] = pvm[3]  + sign * pvm[i];
+			p[1] = pvm[7]  + sign * pvm[4 + i];
+			p[2] = pvm[11] + sign * pvm[8 + i];
+			p[3] = pvm[15] + sign * pvm[12 + i];
+
+			float len = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+			for (int k = 0; k < 4; ++k) p[k] /= len;
+		}
+	}
+}
+
+int is_visible(const float *center, float radius, const float planes[24]){
+	bool fully_in = true;
+	for (int i = 0; i < 6; ++i) {
+		const float *p = &planes[4 * i];
+		float d = p[0] * center[0] + p[1] * center[1] + p[2] * center[2] + p[3];
+		if (d < -radius) return 0;
+		fully_in = fully_in && (d >= radius);
+	}
+	return fully_in ? 2 : 1;
+}
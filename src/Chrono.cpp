@@ -4,7 +4,8 @@
 
 #include "Chrono.h"
 
-struct timeval tv0, tv1;
+/* Per thread, the model is built while the viewer runs */
+thread_local struct timeval tv0, tv1;
 
 void TimerStart()
 {
@@ -32,6 +33,11 @@ unsigned TimerStop(const char *str)
 	return (mus);
 }
 
+double TimerNow()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 char *GetCurrentTime()
 {
 	time_t now = time(0);
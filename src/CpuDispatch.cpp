@@ -0,0 +1,326 @@
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <iostream>
+#include "CpuDispatch.h"
+#include "Chrono.h"
+#include "mesh_simplify/meshoptimizer_mod.h"
+
+using namespace std;
+
+/* Each kernel body is written once and inlined into one function per instruction set, the tails of the fixed
+ * steps stay scalar. The makefile builds this file without FMA contraction (AVX-512 brings FMA): the results are
+ * bit-exact with the scalar code they replace. The tuning of the first CPUs of a set enables the gathers that
+ * the generic one leaves out, and the full width of AVX-512 */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define SC_KERNEL_BODY static inline __attribute__((always_inline))
+    #define SC_TARGET_AVX2 __attribute__((target("avx2,tune=haswell")))
+    #define SC_TARGET_AVX512 __attribute__((target("avx512f,tune=skylake-avx512,prefer-vector-width=512")))
+    #define SC_HAS_CPU_TARGETS 1
+#else
+    #define SC_KERNEL_BODY static inline
+    #define SC_HAS_CPU_TARGETS 0
+#endif
+
+static constexpr int SC_KERNEL_STEP = 16;
+
+SC_KERNEL_BODY void BoundsBody(const float *positions, size_t vertCount, float min[3], float max[3])
+{
+    /* 3 * SC_KERNEL_STEP lanes of min and max, lane k holds the axis k % 3 */
+    float lo[3 * SC_KERNEL_STEP], hi[3 * SC_KERNEL_STEP];
+    for (int k = 0; k < 3 * SC_KERNEL_STEP; ++k)
+    {
+        lo[k] = min[k % 3];
+        hi[k] = max[k % 3];
+    }
+
+    size_t count = vertCount * 3;
+    size_t i = 0;
+    for (; i + 3 * SC_KERNEL_STEP <= count; i += 3 * SC_KERNEL_STEP)
+    {
+        for (int k = 0; k < 3 * SC_KERNEL_STEP; ++k)
+        {
+            float v = positions[i + k];
+            lo[k] = v < lo[k] ? v : lo[k];
+            hi[k] = v > hi[k] ? v : hi[k];
+        }
+    }
+
+    for (int k = 0; k < 3 * SC_KERNEL_STEP; ++k)
+    {
+        min[k % 3] = lo[k] < min[k % 3] ? lo[k] : min[k % 3];
+        max[k % 3] = hi[k] > max[k % 3] ? hi[k] : max[k % 3];
+    }
+    for (; i < count; ++i)
+    {
+        min[i % 3] = positions[i] < min[i % 3] ? positions[i] : min[i % 3];
+        max[i % 3] = positions[i] > max[i % 3] ? positions[i] : max[i % 3];
+    }
+}
+
+/* normalized(cross(p1 - p0, p2 - p0)) of math/vec3.h */
+SC_KERNEL_BODY void FaceNormalBody(const float *p0, const float *p1, const float *p2, float *normal)
+{
+    float e1x = p1[0] - p0[0], e1y = p1[1] - p0[1], e1z = p1[2] - p0[2];
+    float e2x = p2[0] - p0[0], e2y = p2[1] - p0[1], e2z = p2[2] - p0[2];
+    float x = e1y * e2z - e1z * e2y;
+    float y = e1z * e2x - e1x * e2z;
+    float z = e1x * e2y - e1y * e2x;
+    float len = sqrtf(x * x + y * y + z * z);
+    float s = 1.f / (len + float(len == 0));
+    normal[0] = x * s, normal[1] = y * s, normal[2] = z * s;
+}
+
+SC_KERNEL_BODY void FaceNormalsBody(const float *positions, const uint32_t *indices, size_t indexCount, float *normals)
+{
+    size_t triCount = indexCount / 3;
+    size_t t = 0;
+    for (; t + SC_KERNEL_STEP <= triCount; t += SC_KERNEL_STEP)
+    {
+        /* Corners of the step gathered in SoA, the arithmetic runs on full vectors */
+        float corners[9][SC_KERNEL_STEP];
+        for (int k = 0; k < SC_KERNEL_STEP; ++k)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                const float *p = &positions[3 * indices[3 * (t + k) + c]];
+                corners[3 * c][k] = p[0], corners[3 * c + 1][k] = p[1], corners[3 * c + 2][k] = p[2];
+            }
+        }
+
+        float *n = &normals[3 * t];
+        for (int k = 0; k < SC_KERNEL_STEP; ++k)
+        {
+            float p0[3] = {corners[0][k], corners[1][k], corners[2][k]};
+            float p1[3] = {corners[3][k], corners[4][k], corners[5][k]};
+            float p2[3] = {corners[6][k], corners[7][k], corners[8][k]};
+            FaceNormalBody(p0, p1, p2, &n[3 * k]);
+        }
+    }
+    for (; t < triCount; ++t)
+    {
+        const uint32_t *tri = &indices[3 * t];
+        FaceNormalBody(&positions[3 * tri[0]], &positions[3 * tri[1]], &positions[3 * tri[2]], &normals[3 * t]);
+    }
+}
+
+SC_KERNEL_BODY void NormalizeBody(float *vectors, size_t count)
+{
+    size_t i = 0;
+    for (; i + SC_KERNEL_STEP <= count; i += SC_KERNEL_STEP)
+    {
+        float *v = &vectors[3 * i];
+        for (int k = 0; k < SC_KERNEL_STEP; ++k)
+        {
+            float x = v[3 * k], y = v[3 * k + 1], z = v[3 * k + 2];
+            float len = sqrtf(x * x + y * y + z * z);
+            float s = 1.f / (len + float(len == 0));
+            v[3 * k] = x * s, v[3 * k + 1] = y * s, v[3 * k + 2] = z * s;
+        }
+    }
+    for (; i < count; ++i)
+    {
+        float *v = &vectors[3 * i];
+        float len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        float s = 1.f / (len + float(len == 0));
+        v[0] = v[0] * s, v[1] = v[1] * s, v[2] = v[2] * s;
+    }
+}
+
+SC_KERNEL_BODY void RemapIndicesBody(uint32_t *indices, size_t indexCount, const uint32_t *__restrict remap)
+{
+    size_t i = 0;
+    for (; i + SC_KERNEL_STEP <= indexCount; i += SC_KERNEL_STEP)
+    {
+        for (int k = 0; k < SC_KERNEL_STEP; ++k)
+        {
+            indices[i + k] = remap[indices[i + k]];
+        }
+    }
+    for (; i < indexCount; ++i)
+    {
+        indices[i] = remap[indices[i]];
+    }
+}
+
+SC_KERNEL_BODY void OffsetIndicesBody(uint32_t *destination, const uint32_t *source, size_t indexCount, uint32_t offset)
+{
+    size_t i = 0;
+    for (; i + SC_KERNEL_STEP <= indexCount; i += SC_KERNEL_STEP)
+    {
+        for (int k = 0; k < SC_KERNEL_STEP; ++k)
+        {
+            destination[i + k] = source[i + k] + offset;
+        }
+    }
+    for (; i < indexCount; ++i)
+    {
+        destination[i] = source[i] + offset;
+    }
+}
+
+/* One set of entry points per instruction set */
+#define SC_CPU_KERNELS(SUFFIX, TARGET)                                                                                         \
+    TARGET static void Bounds##SUFFIX(const float *positions, size_t vertCount, float min[3], float max[3])                    \
+    {                                                                                                                          \
+        BoundsBody(positions, vertCount, min, max);                                                                            \
+    }                                                                                                                          \
+    TARGET static void FaceNormals##SUFFIX(const float *positions, const uint32_t *indices, size_t indexCount, float *normals) \
+    {                                                                                                                          \
+        FaceNormalsBody(positions, indices, indexCount, normals);                                                              \
+    }                                                                                                                          \
+    TARGET static void Normalize##SUFFIX(float *vectors, size_t count)                                                         \
+    {                                                                                                                          \
+        NormalizeBody(vectors, count);                                                                                         \
+    }                                                                                                                          \
+    TARGET static void RemapIndices##SUFFIX(uint32_t *indices, size_t indexCount, const uint32_t *remap)                        \
+    {                                                                                                                          \
+        RemapIndicesBody(indices, indexCount, remap);                                                                          \
+    }                                                                                                                          \
+    TARGET static void OffsetIndices##SUFFIX(uint32_t *destination, const uint32_t *source, size_t indexCount,                \
+                                             uint32_t offset)                                                                  \
+    {                                                                                                                          \
+        OffsetIndicesBody(destination, source, indexCount, offset);                                                            \
+    }                                                                                                                          \
+    static const CpuKernels cpuKernels##SUFFIX = {Bounds##SUFFIX, FaceNormals##SUFFIX, Normalize##SUFFIX,                    \
+                                                  RemapIndices##SUFFIX, OffsetIndices##SUFFIX};
+
+SC_CPU_KERNELS(Sse2, )
+#if SC_HAS_CPU_TARGETS
+SC_CPU_KERNELS(Avx2, SC_TARGET_AVX2)
+SC_CPU_KERNELS(Avx512, SC_TARGET_AVX512)
+#endif
+
+CpuKernels cpuKernels = cpuKernelsSse2;
+
+static const CpuKernels &KernelsOfLevel(CpuLevel level)
+{
+#if SC_HAS_CPU_TARGETS
+    if (level == SC_CPU_AVX512)
+    {
+        return cpuKernelsAvx512;
+    }
+    if (level == SC_CPU_AVX2)
+    {
+        return cpuKernelsAvx2;
+    }
+#endif
+    return cpuKernelsSse2;
+}
+
+CpuLevel DetectCpuLevel()
+{
+#if SC_HAS_CPU_TARGETS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return SC_CPU_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return SC_CPU_AVX2;
+    }
+#endif
+    return SC_CPU_SSE2;
+}
+
+CpuLevel SelectCpuKernels(CpuLevel level)
+{
+    CpuLevel supported = DetectCpuLevel();
+    level = level > supported ? supported : level;
+    cpuKernels = KernelsOfLevel(level);
+    return level;
+}
+
+const char *CpuLevelName(CpuLevel level)
+{
+    static const char *names[SC_CPU_LEVEL_COUNT] = {"SSE2", "AVX2", "AVX-512"};
+    return names[level];
+}
+
+void BenchmarkKernels(const float *positions, size_t vertCount, const uint32_t *indices, size_t indexCount)
+{
+    static constexpr int SC_BENCH_RUNS = 10;
+    static const char *kernelNames[] = {"bounds", "faceNormals", "normalize", "remapIndices", "offsetIndices"};
+
+    /* Remap of the duplicated positions, a block of the simplifier sees the same */
+    vector<uint32_t> remap(vertCount);
+    meshopt_generateVertexRemap(remap.data(), NULL, vertCount, positions, vertCount, 3 * sizeof(float));
+
+    size_t triCount = indexCount / 3;
+    vector<float> faceNormals[SC_CPU_LEVEL_COUNT], vectors[SC_CPU_LEVEL_COUNT];
+    vector<uint32_t> remapped[SC_CPU_LEVEL_COUNT], offset[SC_CPU_LEVEL_COUNT];
+    float bounds[SC_CPU_LEVEL_COUNT][6];
+    double seconds[SC_CPU_LEVEL_COUNT][5] = {};
+
+    CpuLevel supported = DetectCpuLevel();
+    for (int level = SC_CPU_SSE2; level <= supported; ++level)
+    {
+        const CpuKernels &kernels = KernelsOfLevel(CpuLevel(level));
+        faceNormals[level].resize(3 * triCount);
+        offset[level].resize(indexCount);
+
+        for (int run = 0; run < SC_BENCH_RUNS; ++run)
+        {
+            float *bound = bounds[level];
+            bound[0] = bound[1] = bound[2] = INFINITY;
+            bound[3] = bound[4] = bound[5] = -INFINITY;
+            double start = TimerNow();
+            kernels.bounds(positions, vertCount, bound, bound + 3);
+            seconds[level][0] += TimerNow() - start;
+
+            start = TimerNow();
+            kernels.faceNormals(positions, indices, indexCount, faceNormals[level].data());
+            seconds[level][1] += TimerNow() - start;
+
+            vectors[level].assign(faceNormals[level].begin(), faceNormals[level].end());
+            for (size_t i = 0; i < vectors[level].size(); ++i)
+            {
+                vectors[level][i] *= 3.f;
+            }
+            start = TimerNow();
+            kernels.normalize(vectors[level].data(), triCount);
+            seconds[level][2] += TimerNow() - start;
+
+            remapped[level].assign(indices, indices + indexCount);
+            start = TimerNow();
+            kernels.remapIndices(remapped[level].data(), indexCount, remap.data());
+            seconds[level][3] += TimerNow() - start;
+
+            start = TimerNow();
+            kernels.offsetIndices(offset[level].data(), indices, indexCount, 1024);
+            seconds[level][4] += TimerNow() - start;
+        }
+    }
+
+    cout << "Kernel bench, vertices: " << vertCount << " triangles: " << triCount << ", ms per run" << endl;
+    for (int k = 0; k < 5; ++k)
+    {
+        cout << kernelNames[k] << ":";
+        for (int level = SC_CPU_SSE2; level <= supported; ++level)
+        {
+            bool isSame = true;
+            switch (k)
+            {
+            case 0:
+                isSame = !memcmp(bounds[level], bounds[0], sizeof(bounds[0]));
+                break;
+            case 1:
+                isSame = !memcmp(faceNormals[level].data(), faceNormals[0].data(), faceNormals[0].size() * sizeof(float));
+                break;
+            case 2:
+                isSame = !memcmp(vectors[level].data(), vectors[0].data(), vectors[0].size() * sizeof(float));
+                break;
+            case 3:
+                isSame = remapped[level] == remapped[0];
+                break;
+            case 4:
+                isSame = offset[level] == offset[0];
+                break;
+            }
+            cout << " " << CpuLevelName(CpuLevel(level)) << " " << seconds[level][k] * 1e3 / SC_BENCH_RUNS
+                 << " (x" << seconds[0][k] / seconds[level][k] << (isSame ? ")" : ", MISMATCH)");
+        }
+        cout << endl;
+    }
+}
@@ -12,27 +12,61 @@ void Cube::ComputeBottomVertex(float bottom[3], int coord[3], float length, floa
     }
 }
 
-/*
-    Compute the Bounding Box vertex
-         F----G
-        /|    /|
-        E|---H |
-        | A--|-B
-        |/   |/
-        D----C
-            
-*/
-void Cube::CalculateBBXVertex(float length)
+void Cube::ComputeTightBounds(const float *positions, int count, Cube **children, int childCount)
 {
-    float vertices[24] = {
-        bottom[0], bottom[1], bottom[2],                           // A
-        bottom[0], bottom[1] + length, bottom[2],                  // B
-        bottom[0] + length, bottom[1] + length, bottom[2],         // C
-        bottom[0] + length, bottom[1], bottom[2],                  // D
-        bottom[0] + length, bottom[1], bottom[2] + length,         // E
-        bottom[0], bottom[1], bottom[2] + length,                  // F
-        bottom[0], bottom[1] + length, bottom[2] + length,         // G
-        bottom[0] + length, bottom[1] + length, bottom[2] + length // H
-    };
-    memcpy(bbxVertices, vertices, 24 * sizeof(float));
-}
\ No newline at end of file
+    for (int i = 0; i < count; ++i)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            tightMin[k] = min(tightMin[k], positions[3 * i + k]);
+            tightMax[k] = max(tightMax[k], positions[3 * i + k]);
+        }
+    }
+
+    for (int c = 0; c < childCount; ++c)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            tightMin[k] = min(tightMin[k], children[c]->tightMin[k]);
+            tightMax[k] = max(tightMax[k], children[c]->tightMax[k]);
+        }
+    }
+
+    /* Sphere centered on the box, the radius reaches the farthest vertex or child sphere */
+    float radius2 = 0.0f;
+    for (int k = 0; k < 3; ++k)
+    {
+        center[k] = 0.5f * (tightMin[k] + tightMax[k]);
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        float dx = positions[3 * i] - center[0];
+        float dy = positions[3 * i + 1] - center[1];
+        float dz = positions[3 * i + 2] - center[2];
+        radius2 = max(radius2, dx * dx + dy * dy + dz * dz);
+    }
+    radius = sqrtf(radius2);
+
+    for (int c = 0; c < childCount; ++c)
+    {
+        float dx = children[c]->center[0] - center[0];
+        float dy = children[c]->center[1] - center[1];
+        float dz = children[c]->center[2] - center[2];
+        radius = max(radius, sqrtf(dx * dx + dy * dy + dz * dz) + children[c]->radius);
+    }
+}
+
+void Cube::ExpandBounds(const float *point)
+{
+    for (int k = 0; k < 3; ++k)
+    {
+        tightMin[k] = min(tightMin[k], point[k]);
+        tightMax[k] = max(tightMax[k], point[k]);
+    }
+
+    float dx = point[0] - center[0];
+    float dy = point[1] - center[1];
+    float dz = point[2] - center[2];
+    radius = max(radius, sqrtf(dx * dx + dy * dy + dz * dz));
+}
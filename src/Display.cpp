@@ -2,145 +2,337 @@
 #include "./math/vec4.h"
 #include "./math/transform.h"
 
-Vec3 freezeVp;
 Viewer *viewer = new Viewer;                              /* Initialize the viewer */
-std::stack<std::pair<int, uint64_t>> freezeRenderStack;   /*freeze stack*/
-stack<pair<int, uint64_t>> renderStack;                   /* Render stack */
 size_t renderedTriSum = 0;
+/* Selection state, only touched by the running selection */
+SelectionInput selInput;                                  /* camera sample of the running selection */
+RenderList *selectList = NULL;                            /* back list filled by the cube selection */
+float levelKappa[SC_MAX_LOD_LEVEL];                       /* distance factor of each level, indexed by level */
+float frustumPlanes[24];                                  /* frustum planes of the sampled camera, model space */
 GLuint pos, nml, clr, remap, uv, idx;       
+GLuint morphVtx;                                          /* interleaved vertices of SC_INTERLEAVED_VERTEX */
+vector<unsigned char> indexStream;                        /* CPU sources of the streamed upload, released once resident */
+vector<MorphVertex> morphVertices;
 
-void SaveScreenshotToFile(std::string filename, int windowWidth, int windowHeight){
-    const int numberOfPixels = windowWidth * windowHeight * 3;
-    unsigned char pixels[numberOfPixels];
+float CalculateDistanceToCube(Cube &cube, Vec3 viewpoint, Mat4& model){
+    /* The tight bounds clipped by the cell: never closer than the cell, so the crack free distance bands still hold */
+    Vec3 bottom = transform(model, Vec3{max(cube.tightMin[0], cube.bottom[0]), max(cube.tightMin[1], cube.bottom[1]), max(cube.tightMin[2], cube.bottom[2])});
+    Vec3 top = transform(model, Vec3{min(cube.tightMax[0], cube.top[0]), min(cube.tightMax[1], cube.top[1]), min(cube.tightMax[2], cube.top[2])});
 
-    glPixelStorei(GL_PACK_ALIGNMENT, 1);
-    glReadBuffer(GL_FRONT);
-    glReadPixels(0, 0, windowWidth, windowHeight, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    /* Chebyshev distance */
+    float disX = max(max(bottom.x - viewpoint.x, viewpoint.x - top.x), 0.0f);
+    float disY = max(max(bottom.y - viewpoint.y, viewpoint.y - top.y), 0.0f);
+    float disZ = max(max(bottom.z - viewpoint.z, viewpoint.z - top.z), 0.0f);
 
-    FILE *outputFile = fopen(filename.c_str(), "w");
-    short header[] = {0, 2, 0, 0, 0, 0, (short)windowWidth, (short)windowHeight, 24};
-
-    fwrite(&header, sizeof(header), 1, outputFile);
-    fwrite(pixels, numberOfPixels, 1, outputFile);
-    fclose(outputFile);
-
-    printf("Finish writing to file.\n");
+    return max(max(disX, disY), disZ);
 }
 
-float CalculateDistanceToCube(float cubeBottom[3], Vec3 viewpoint, Mat4& model, float cubeLength){
-    float maxDis = 0.0f;
-    Vec3 bottom = transform(model, Vec3{cubeBottom[0], cubeBottom[1], cubeBottom[2]});
-    Vec3 length = transform(model, Vec3{cubeLength, cubeLength, cubeLength});
-
-    float disX = 0.0f;
-    if (viewpoint.x < bottom.x) disX = abs(bottom.x - viewpoint.x);
-    else if (viewpoint.x > bottom.x + length[0]) disX = abs(viewpoint.x - bottom.x - length[0]);
-    else disX = 0.0f;
-
-    float disY = 0.0f;
-    if (viewpoint.y < bottom.y) disY = abs(bottom.y - viewpoint.y);
-    else if (viewpoint.y > bottom.y + length[1]) disY = abs(viewpoint.y - bottom.y - length[1]);
-    else disY = 0.0f;
-
-    float disZ = 0.0f;
-    if (viewpoint.z < bottom.z) disZ = abs(bottom.z - viewpoint.z);
-    else if (viewpoint.z > bottom.z + length[2]) disZ = abs(viewpoint.z - bottom.z - length[2]);
-    else disZ = 0.0f;
-
-    maxDis = max(max(disX, disY), disZ);
-    return maxDis;
+void ComputeLevelKappa(LOD *meshbook[], int maxLevel, float modelScale, float pixelScale, float pixelError, float sigma){
+    /* The cube of level l is drawn when d >= kappa_l * 2^-l. Screen-space error e * pixelScale / d <= pixelError
+     * gives kappa_l = e_l * pixelScale / pixelError * 2^l with the max error of the level, so that all the cubes
+     * of a level share the same distance band and the geomorphing between two levels stays crack free. */
+    float minKappa = 1.0f + 4.0f * sigma;
+    for (int i = 0; i <= maxLevel; ++i){
+        int l = meshbook[i]->level;
+        float kappa = meshbook[i]->maxError * modelScale * pixelScale / pixelError * (1 << l);
+        kappa = max(kappa, minKappa);
+
+        /* Keep the morphing band of the finer level inside the distance range of this level */
+        if (i > 0){
+            kappa = max(kappa, 0.5f * (1.0f + levelKappa[l + 1] + 4.0f * sigma));
+        }
+        levelKappa[l] = kappa;
+    }
 }
 
-int LoadChildCube(int parentCoord[3], LOD *meshbook[], Mat4& pvmMat, Mat4& model, Camera* camera, int maxLevel, int curLevel){
+int LoadChildCube(Cube &parent, LOD *meshbook[], Mat4& pvmMat, Mat4& model, int maxLevel, int curLevel, bool isInside){
     if (curLevel < 0) return -1;
     LOD *mg = meshbook[curLevel];
-    int xyz[3];
+    int childCount = __builtin_popcount(parent.childMask);
 
-    for (int ix = 0; ix < 2; ix++){
-        xyz[0] = parentCoord[0] * 2 + ix;
-        
-        for (int iy = 0; iy < 2; iy++){
-            xyz[1] = parentCoord[1] * 2 + iy;
-            
-            for (int iz = 0; iz < 2; iz++){
-                
-                xyz[2] = parentCoord[2] * 2 + iz;
-                uint64_t coord = (uint64_t)(xyz[0]) | ((uint64_t)(xyz[1]) << 16) | ((uint64_t)(xyz[2]) << 32);
-                
-                if (mg->cubeTable.count(coord) == 0){
-                    continue;
-                }
-                    
-                float dis = CalculateDistanceToCube(mg->cubeTable[coord].bottom, camera->position, model, mg->cubeLength); 
-
-                if (dis >= (viewer->imgui->kappa * pow(2, -(mg->level))) || mg->level == maxLevel){
-                    if (AfterFrustumCulling(mg->cubeTable[coord], pvmMat)){
-                        renderStack.push(make_pair(mg->level, coord));
-                    }
-                }
-                else{
-                    LoadChildCube(xyz, meshbook, pvmMat, model, camera, maxLevel, curLevel - 1);
-                }
+    for (int i = 0; i < childCount; i++){
+        Cube &cube = *mg->cubeArray[parent.childIdx + i];
 
+        /* The cubes of a parent fully inside the frustum are inside as well */
+        bool isChildInside = isInside;
+        if (!isInside){
+            int visible = FrustumTest(cube, pvmMat);
+            if (visible == 0){
+                continue;
             }
+            isChildInside = (visible == 2);
+        }
+            
+        float dis = CalculateDistanceToCube(cube, selInput.viewpoint, model); 
+
+        if (dis >= (levelKappa[mg->level] * pow(2, -(mg->level))) || cube.isLeaf || !IsChildrenResident(cube, curLevel - 1)){
+            selectList->Push(meshbook, curLevel, cube, dis);
+        }
+        else{
+            LoadChildCube(cube, meshbook, pvmMat, model, maxLevel, curLevel - 1, isChildInside);
         }
     }
     return 0;
 }
 
-bool AfterFrustumCulling(Cube &cube, Mat4 pvm){
+bool IsChildrenResident(Cube &cube, int childLodIdx){
+    /* The children are contiguous in the cube array, uploaded in its order */
+    return cube.childIdx + __builtin_popcount(cube.childMask) <= (int)selInput.residentCubes[childLodIdx];
+}
+
+int FrustumTest(Cube &cube, Mat4& pvm){
+    /* The bounding sphere settles most of the cubes, the box only when it intersects a plane */
+    int visible = is_visible(cube.center, cube.radius, frustumPlanes);
+    if (visible != 1){
+        return visible;
+    }
+
     Aabb bbox;
-    bbox.min.x = cube.bottom[0];
-    bbox.min.y = cube.bottom[1];
-    bbox.min.z = cube.bottom[2];
-    bbox.max.x = cube.top[0];
-    bbox.max.y = cube.top[1];
-    bbox.max.z = cube.top[2];
-
-    int visible = is_visible(bbox, &pvm(0, 0));
-    if (visible != 0) return true;
-    else return false;
+    bbox.min.x = cube.tightMin[0];
+    bbox.min.y = cube.tightMin[1];
+    bbox.min.z = cube.tightMin[2];
+    bbox.max.x = cube.tightMax[0];
+    bbox.max.y = cube.tightMax[1];
+    bbox.max.z = cube.tightMax[2];
+
+    return is_visible(bbox, &pvm(0, 0));
 }
 
 void SelectCubeVisbility(LOD *meshbook[], int maxLevel, Mat4& pvmMat, Mat4& model){
-    for (auto &c : meshbook[maxLevel]->cubeTable){
-        float dis = CalculateDistanceToCube(c.second.bottom, viewer->camera->position, model, meshbook[maxLevel]->cubeLength); 
-        if (dis >= (viewer->imgui->kappa * pow(2, -meshbook[maxLevel]->level)) || meshbook[maxLevel]->level == maxLevel){
-            if (AfterFrustumCulling(c.second, pvmMat)){
-                renderStack.push(make_pair(meshbook[maxLevel]->level, c.first));
-            }
+    for (size_t r = 0; r < selInput.residentCubes[maxLevel]; ++r){
+        Cube *c = meshbook[maxLevel]->cubeArray[r];
+        /* A root cube outside the frustum prunes its whole subtree */
+        int visible = selInput.isFrustumCulling ? FrustumTest(*c, pvmMat) : 2;
+        if (visible == 0){
+            continue;
+        }
+
+        float dis = CalculateDistanceToCube(*c, selInput.viewpoint, model); 
+        if (dis >= (levelKappa[meshbook[maxLevel]->level] * pow(2, -meshbook[maxLevel]->level)) || c->isLeaf || !IsChildrenResident(*c, maxLevel - 1)){
+            selectList->Push(meshbook, maxLevel, *c, dis);
         }
         else{
-            LoadChildCube(c.second.coord, meshbook, pvmMat, model, viewer->camera, maxLevel, maxLevel - 1);
+            LoadChildCube(*c, meshbook, pvmMat, model, maxLevel, maxLevel - 1, visible == 2);
         }
     }
     
 }
 
-void ObjectBufferInit(Mesh& data){
-    /* Position */
-    glGenBuffers(1, &pos);
-    glBindBuffer(GL_ARRAY_BUFFER, pos);
-    glBufferData(GL_ARRAY_BUFFER, data.posCount * VERTEX_STRIDE, &(data.positions[0]), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+float RefinementPriority(LOD *mg, Cube &cube, Mat4& model){
+    float dis = CalculateDistanceToCube(cube, selInput.viewpoint, model);
+    float threshold = levelKappa[mg->level] * pow(2, -mg->level);
+    return dis > 0.0f ? threshold / dis : FLT_MAX;
+}
 
-    /* Normal */
-    glGenBuffers(1, &nml);
-    glBindBuffer(GL_ARRAY_BUFFER, nml);
-    glBufferData(GL_ARRAY_BUFFER, data.posCount * VERTEX_STRIDE, &(data.normals[0]), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+float SelectCubeBudget(LOD *meshbook[], int maxLevel, Mat4& pvmMat, Mat4& model, size_t triBudget){
+    /* Refining the cubes by decreasing priority is the distance rule with the factors scaled by 1 / priority
+     * of the first cube left, the scale may not go below the one keeping the morphing bands crack free */
+    float sigma = selInput.sigma;
+    float minScale = 0.0f;
+    for (int l = 0; l <= maxLevel; ++l){
+        minScale = max(minScale, (1.0f + 4.0f * sigma) / levelKappa[l]);
+        if (l < maxLevel && 2.0f * levelKappa[l] - levelKappa[l + 1] > 0.0f){
+            minScale = max(minScale, (1.0f + 4.0f * sigma) / (2.0f * levelKappa[l] - levelKappa[l + 1]));
+        }
+    }
 
-    /* Parent-children dependency */
-    glGenBuffers(1, &remap);
-    glBindBuffer(GL_ARRAY_BUFFER, remap);
-    glBufferData(GL_ARRAY_BUFFER, data.posCount * sizeof(uint32_t), &(data.remap[0]), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    priority_queue<CubeRefinement> heap;
+    size_t triCount = 0;
+    for (size_t r = 0; r < selInput.residentCubes[maxLevel]; ++r){
+        Cube *c = meshbook[maxLevel]->cubeArray[r];
+        int visible = selInput.isFrustumCulling ? FrustumTest(*c, pvmMat) : 2;
+        if (visible == 0){
+            continue;
+        }
 
-    /* Index */
-    glGenBuffers(1, &idx);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.idxCount * sizeof(uint32_t), &(data.indices[0]), GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        triCount += c->triangleCount;
+        if (c->isLeaf){
+            selectList->Push(meshbook, maxLevel, *c, CalculateDistanceToCube(*c, selInput.viewpoint, model));
+        }
+        else{
+            heap.push({RefinementPriority(meshbook[maxLevel], *c, model), maxLevel, c, visible == 2});
+        }
+    }
+
+    float scale = 1.0f;
+    Cube *children[8];
+    bool isChildInside[8];
+    while (!heap.empty()){
+        CubeRefinement top = heap.top();
+        if (top.priority <= 1.0f){
+            break;
+        }
+
+        /* Cubes whose children are not uploaded yet stay as they are */
+        LOD *mg = meshbook[top.lodIdx - 1];
+        Cube &parent = *top.cube;
+        if (!IsChildrenResident(parent, top.lodIdx - 1)){
+            selectList->Push(meshbook, top.lodIdx, parent, CalculateDistanceToCube(parent, selInput.viewpoint, model));
+            heap.pop();
+            continue;
+        }
+
+        /* Visible children replacing the cube */
+        int childCount = 0;
+        size_t childTriCount = 0;
+        for (int i = 0; i < __builtin_popcount(parent.childMask); ++i){
+            Cube *child = mg->cubeArray[parent.childIdx + i];
+            int visible = top.isInside ? 2 : FrustumTest(*child, pvmMat);
+            if (visible == 0){
+                continue;
+            }
+            isChildInside[childCount] = (visible == 2);
+            children[childCount++] = child;
+            childTriCount += child->triangleCount;
+        }
+
+        if (triCount + childTriCount - parent.triangleCount > triBudget && top.priority * minScale <= 1.0f){
+            scale = 1.0f / top.priority;
+            break;
+        }
+
+        heap.pop();
+        triCount = triCount + childTriCount - parent.triangleCount;
+        for (int i = 0; i < childCount; ++i){
+            Cube &child = *children[i];
+            if (child.isLeaf){
+                selectList->Push(meshbook, top.lodIdx - 1, child, CalculateDistanceToCube(child, selInput.viewpoint, model));
+            }
+            else{
+                heap.push({RefinementPriority(mg, child, model), top.lodIdx - 1, &child, isChildInside[i]});
+            }
+        }
+    }
+
+    while (!heap.empty()){
+        Cube &cube = *heap.top().cube;
+        selectList->Push(meshbook, heap.top().lodIdx, cube, CalculateDistanceToCube(cube, selInput.viewpoint, model));
+        heap.pop();
+    }
+
+    return scale;
+}
+
+void RunSelection(SelectionWorker *worker, const SelectionInput &in){
+    pthread_mutex_lock(&worker->selectMutex);
+    SC_TRACE_ZONE_ARG("Selection", "frame", in.frame);
+    double start = TimerNow();
+    HLOD &hlod = *worker->hlod;
+    int maxLevel = worker->maxLevel;
+    selInput = in;
+    selectList = worker->exchange.back;
+    selectList->Clear();
+
+    frustum_planes(&selInput.pvm(0, 0), frustumPlanes);
+    ComputeLevelKappa(hlod.lods, maxLevel, in.modelScale, in.pixelScale, in.pixelError, in.sigma);
+
+    float budgetScale = 1.0f;
+    if (in.isTriangleBudget){
+        budgetScale = SelectCubeBudget(hlod.lods, maxLevel, selInput.pvm, selInput.model, in.triangleBudget);
+    }
+    else{
+        SelectCubeVisbility(hlod.lods, maxLevel, selInput.pvm, selInput.model);
+    }
+    double listStart = TimerNow();
+    selectList->SortFrontToBack();
+
+    /* Software occlusion culling of the selected cubes */
+    selectList->occludedCount = 0;
+    selectList->occluderTriCount = 0;
+    selectList->occlusionTime = 0.0f;
+    if (in.isOcclusionCulling){
+        /* Model matrix is a uniform scale, the eye in object space */
+        float eye[3] = {in.viewpoint.x / in.modelScale, in.viewpoint.y / in.modelScale, in.viewpoint.z / in.modelScale};
+        double occlusionStart = TimerNow();
+        SC_TRACE_BEGIN(occlusionZone, "OcclusionCulling");
+        selectList->occludedCount = worker->culler->Cull(hlod, maxLevel, *selectList, &selInput.pvm(0, 0), eye, in.nearPlane);
+        SC_TRACE_END(occlusionZone);
+        selectList->occlusionTime = (TimerNow() - occlusionStart) * 1000.0;
+        selectList->occluderTriCount = worker->culler->occluderTriCount;
+    }
+
+    /* The list is drawn with the distance factors it was selected with */
+    for (int l = 0; l < SC_MAX_LOD_LEVEL; ++l){
+        selectList->kappa[l] = levelKappa[l] * budgetScale;
+    }
+    selectList->budgetScale = budgetScale;
+    selectList->viewpoint = in.viewpoint;
+    selectList->frame = in.frame;
+    selectList->sampleTime = in.sampleTime;
+    selectList->selectionTime = (TimerNow() - start) * 1000.0;
+    selectList->listTime = (TimerNow() - listStart) * 1000.0;
+
+    worker->exchange.Publish();
+    pthread_mutex_unlock(&worker->selectMutex);
+}
+
+void PostSelection(SelectionWorker *worker, const SelectionInput &in){
+    /* A sample not taken yet is replaced, the selection always starts from the latest camera */
+    pthread_mutex_lock(&worker->inputMutex);
+    worker->input = in;
+    worker->hasInput = true;
+    pthread_cond_signal(&worker->inputCond);
+    pthread_mutex_unlock(&worker->inputMutex);
+}
+
+void *SelectionLoop(void *arg){
+    SelectionWorker *worker = (SelectionWorker *)arg;
+    SelectionInput in;
+    SC_TRACE_THREAD("selection");
+
+    while (true){
+        pthread_mutex_lock(&worker->inputMutex);
+        while (!worker->hasInput && worker->isRunning){
+            pthread_cond_wait(&worker->inputCond, &worker->inputMutex);
+        }
+        if (!worker->isRunning){
+            pthread_mutex_unlock(&worker->inputMutex);
+            break;
+        }
+        in = worker->input;
+        worker->hasInput = false;
+        pthread_mutex_unlock(&worker->inputMutex);
+
+        RunSelection(worker, in);
+    }
+    return NULL;
+}
+
+void ObjectBufferInit(HLOD &hlod, int maxLevel, GpuUploader &uploader){
+    Mesh &data = hlod.data;
+    size_t wideCubeCount = hlod.BuildIndexStream(maxLevel, indexStream);
+    printf("Index buffer: %.2f MB (%.2f MB with 32 bits indices), %zu cubes with 32 bits indices\n",
+           indexStream.size() / 1048576.0, data.idxCount * sizeof(uint32_t) / 1048576.0, wideCubeCount);
+
+    /* The buffers are only allocated here, the data is streamed by the uploader during the first frames */
+#ifdef SC_INTERLEAVED_VERTEX
+    /* Vertex with its parent position and normal: one 32 byte read per vertex */
+    morphVertices.resize(data.posCount);
+    hlod.BuildMorphVertices(maxLevel, morphVertices.data());
+    morphVtx = uploader.CreateBuffer(data.posCount * sizeof(MorphVertex));
+#else
+    pos = uploader.CreateBuffer(data.posCount * VERTEX_STRIDE);
+    nml = uploader.CreateBuffer(data.posCount * VERTEX_STRIDE);
+    remap = uploader.CreateBuffer(data.posCount * sizeof(uint32_t));
+#endif
+    idx = uploader.CreateBuffer(indexStream.size());
+
+    /* Coarse levels first: the parent vertices a cube morphs to are resident before the cube */
+    for (int k = maxLevel; k >= 0; --k){
+        for (Cube *cube : hlod.lods[k]->cubeArray){
+            size_t v = cube->vertexOffset;
+            size_t vertCount = cube->vertCount;
+#ifdef SC_INTERLEAVED_VERTEX
+            uploader.Add(morphVtx, v * sizeof(MorphVertex), &morphVertices[v], vertCount * sizeof(MorphVertex));
+#else
+            uploader.Add(pos, v * VERTEX_STRIDE, &data.positions[3 * v], vertCount * VERTEX_STRIDE);
+            uploader.Add(nml, v * VERTEX_STRIDE, &data.normals[3 * v], vertCount * VERTEX_STRIDE);
+            uploader.Add(remap, v * sizeof(uint32_t), &data.remap[v], vertCount * sizeof(uint32_t));
+#endif
+            uploader.Add(idx, cube->idxByteOffset, &indexStream[cube->idxByteOffset], 3 * (size_t)cube->triangleCount * cube->indexSize);
+            uploader.EndCube(k);
+        }
+    }
 
     glGenBuffers(1, &uv);
     glGenBuffers(1, &clr);
@@ -148,7 +340,18 @@ void ObjectBufferInit(Mesh& data){
 
 void BindVAOBuffer(GLuint &vao){
     glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    glState.BindVertexArray(vao);
+#ifdef SC_INTERLEAVED_VERTEX
+    glBindBuffer(GL_ARRAY_BUFFER, morphVtx);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MorphVertex), (void *)offsetof(MorphVertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(MorphVertex), (void *)offsetof(MorphVertex, normal));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, sizeof(MorphVertex), (void *)offsetof(MorphVertex, parentPosition));
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(7, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(MorphVertex), (void *)offsetof(MorphVertex, parentNormal));
+    glEnableVertexAttribArray(7);
+#else
     glBindBuffer(GL_ARRAY_BUFFER, pos);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GL_FLOAT),
                             (void *)0);
@@ -163,6 +366,7 @@ void BindVAOBuffer(GLuint &vao){
     glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, 1 * sizeof(GL_UNSIGNED_INT),
                             (void *)0);
     glEnableVertexAttribArray(2);
+#endif
 
     glBindBuffer(GL_ARRAY_BUFFER, uv);
     glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GL_FLOAT),
@@ -175,21 +379,42 @@ void BindVAOBuffer(GLuint &vao){
     glEnableVertexAttribArray(4);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx);
-    glBindVertexArray(0);
+    glState.BindVertexArray(0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     
 }
 
-int Display(HLOD &multiResModel, int maxLevel){
-    Shader *shader = new Shader();
+void ObjectBufferDestroy(GLuint &vao){
+    /* The names of the deleted objects are given out again */
+    glState.Invalidate();
+    glDeleteVertexArrays(1, &vao);
+#ifdef SC_INTERLEAVED_VERTEX
+    glDeleteBuffers(1, &morphVtx);
+#else
+    glDeleteBuffers(1, &pos);
+    glDeleteBuffers(1, &remap);
+    glDeleteBuffers(1, &nml);
+#endif
+    glDeleteBuffers(1, &idx);
+    glDeleteBuffers(1, &uv);
+    glDeleteBuffers(1, &clr);
+}
+
+int Display(HLOD &multiResModel, int maxLevel, HeadlessParams *headless, ProgressiveBuild *build){
+    ShaderVariants *shaderVariants = new ShaderVariants();
+    Shader *shader = NULL;
     Shader *bbxShader = new Shader();
     BoundingBoxDraw* bbxDrawer = new BoundingBoxDraw();
+    OcclusionCuller* occlusionCuller = new OcclusionCuller();
+    GpuUploader *uploader = new GpuUploader();
     string vertexShader = "./shaders/defaultShader.vs";
     string fragmentShader = "./shaders/defaultShader.fs"; 
     float maxModelSize = multiResModel.lods[maxLevel]->cubeLength;
     GLuint vao;                   
     GLuint uboMatices;            
+    GLuint uboFrame;                        /* FrameParameters */
+    FrameParameters frameParams{};
     int frameCount = 0;           
     int renderedCubeCount = 0; 
     bool isNormalVis = false;
@@ -198,14 +423,36 @@ int Display(HLOD &multiResModel, int maxLevel){
     bool isLodColorized = false;
     bool isCubeColorized = false;
     bool isAdaptive = true;
+    bool isHeadless = headless != NULL;
+    CameraPath cameraPath;                  /* replayed offscreen, recorded in the window */
+    OffscreenTarget offscreen;
+    FrameCapture *capture = new FrameCapture();
+    int recordFrameCount = 0;
+    TelemetryWriter timings;                /* timings.csv of the offscreen runs, the exported data of the window */
+    GLuint timerQueries[2];                 /* GPU timestamps at the start and the end of a frame */
+    GpuTimerRing gpuTimers;                 /* per pass GPU times */
+    FrameStats frameStats;
+    double lastFrameStart = 0.0;
+    double cpuTimeSum = 0.0;
+    double gpuTimeSum = 0.0;
+    double finishTimeSum = 0.0;
+    GlCallCounters glCallSum;               /* GL calls of the offscreen frames */
+
+    if (isHeadless){
+        if (!InitHeadlessContext()){
+            return -1;
+        }
+        viewer->Init(headless->width, headless->height);
+    }
+    else{
+        /* Init the glfw init */
+        viewer->InitGlfwFunctions();
 
-    /* Init the glfw init */
-    viewer->InitGlfwFunctions();
-
-    /* Imgui initial*/
-    viewer->imgui->ImguiInial(viewer->window);
-    viewer->imgui->inputVertexCount = multiResModel.lods[0]->totalVertCount;
-    viewer->imgui->inputTriCount = multiResModel.lods[0]->totalTriCount;
+        /* Imgui initial*/
+        viewer->imgui->ImguiInial(viewer->window);
+    }
+    viewer->imgui->inputVertexCount = multiResModel.leafVertCount;
+    viewer->imgui->inputTriCount = multiResModel.leafTriCount;
     viewer->imgui->hlodTriCount = multiResModel.data.idxCount / 3;
     viewer->imgui->hlodVertexCount = multiResModel.data.posCount;
     viewer->imgui->gpuVendorStr = const_cast<unsigned char*>(glGetString(GL_VENDOR));
@@ -225,25 +472,40 @@ int Display(HLOD &multiResModel, int maxLevel){
 
     /* Bind VAO VBO */
     TimerStart();
-    ObjectBufferInit(multiResModel.data);
-    TimerStop("Loading data to GPU: ");
+    if (!uploader->Init()){
+        return -1;
+    }
+    ObjectBufferInit(multiResModel, maxLevel, *uploader);
+    TimerStop("Preparing the GPU upload: ");
+    double uploadStart = TimerNow();
+    bool isUploadReported = false;
     BindVAOBuffer(vao);
 
-    /* Build shader */
-    shader->Build(vertexShader.c_str(), fragmentShader.c_str());
-    unsigned int uniformBlockIndexVertex = glGetUniformBlockIndex(shader->ID, "Matrices");
-    glUniformBlockBinding(shader->ID, uniformBlockIndexVertex, 0);
+    /* Build shader, the variants of the default shader are specialised on the display options */
+#ifdef SC_INTERLEAVED_VERTEX
+    shaderVariants->defines = "#define INTERLEAVED_VERTEX\n";
+#endif
+    if (!shaderVariants->Load(vertexShader, fragmentShader, "./shaders/cache")){
+        return -1;
+    }
 
     bbxShader->Build("./shaders/BbxShader.vs", "./shaders/BbxShader.fs");
     unsigned int uniformBlockIndexBBX = glGetUniformBlockIndex(bbxShader->ID, "Matrices");
-    glUniformBlockBinding(bbxShader->ID, uniformBlockIndexBBX, 0);
+    glUniformBlockBinding(bbxShader->ID, uniformBlockIndexBBX, SC_UBO_MATRICES);
     
     /* Uniform matrices generation */
     glGenBuffers(1, &uboMatices);
     glBindBuffer(GL_UNIFORM_BUFFER, uboMatices);
     glBufferData(GL_UNIFORM_BUFFER, 3 * sizeof(Mat4), NULL, GL_STATIC_DRAW);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
-    glBindBufferRange(GL_UNIFORM_BUFFER, 0, uboMatices, 0, 3 * sizeof(Mat4));
+    glState.BindBufferBase(GL_UNIFORM_BUFFER, SC_UBO_MATRICES, uboMatices);
+
+    /* Parameters of the frame, the same for every cube drawn */
+    glGenBuffers(1, &uboFrame);
+    glBindBuffer(GL_UNIFORM_BUFFER, uboFrame);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameParameters), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glState.BindBufferBase(GL_UNIFORM_BUFFER, SC_UBO_FRAME, uboFrame);
 
     /* Calculate model center */
     viewer->scale = 1.0f / maxModelSize;
@@ -262,19 +524,72 @@ int Display(HLOD &multiResModel, int maxLevel){
     viewer->target = cameraTarget;
 
     /* BBXDrawer initialization */
-    bbxDrawer->InitBuffer(multiResModel.lods[maxLevel]->cubeTable[0], multiResModel.lods[maxLevel]->cubeLength);
+    bbxDrawer->InitBuffer();
+
+    /* Screenshots and frame recording */
+    capture->Init();
+
+    /* Frame breakdown of the overlay and the timings */
+    gpuTimers.Init();
+    viewer->imgui->frameStats = &frameStats;
+
+    /* Offscreen mode: camera path, render target and timing output */
+    if (isHeadless){
+        bool isPathLoaded = false;
+        if (headless->pathFile.compare(0, 10, "turntable:") == 0){
+            cameraPath.Turntable(*viewer->camera, viewer->target, max(1, atoi(headless->pathFile.c_str() + 10)));
+            isPathLoaded = true;
+        }
+        else{
+            isPathLoaded = cameraPath.Load(headless->pathFile);
+        }
+
+        if (!isPathLoaded || !offscreen.Init(headless->width, headless->height) ||
+            !timings.Open(headless->outputDir + "/timings.csv", {"frame", "cpu_ms", "gpu_ms", "finish_ms", "selection_ms", "triangles", "cubes",
+                                                                 "list_ms", "upload_ms", "submit_ms", "gpu_scene_ms", "gpu_bbox_ms"})){
+            cout << "Headless rendering aborted" << endl;
+            DestroyHeadlessContext();
+            return -1;
+        }
+        glGenQueries(2, timerQueries);
+        offscreen.Bind();
+
+        /* Frame i shows the pose i of the path: no pipelining latency, the whole model resident */
+        viewer->imgui->isPipelined = false;
+        uploader->Flush();
+    }
+
+    /* Selection thread */
+    SelectionWorker *worker = new SelectionWorker();
+    worker->hlod = &multiResModel;
+    worker->maxLevel = maxLevel;
+    worker->culler = occlusionCuller;
+    pthread_mutex_init(&worker->inputMutex, NULL);
+    pthread_mutex_init(&worker->selectMutex, NULL);
+    pthread_cond_init(&worker->inputCond, NULL);
+    pthread_create(&worker->thread, NULL, SelectionLoop, (void *)worker);
 
     /* Render loop */
-    while (!glfwWindowShouldClose(viewer->window)){
+    while (isHeadless ? frameCount < (int)cameraPath.Size() : !glfwWindowShouldClose(viewer->window)){
         renderedTriSum = 0; 
         renderedCubeCount = 0;
         frameCount++;
+        glState.EndFrame();
+        viewer->imgui->glCalls = glState.last;
+        SC_TRACE_ZONE_ARG("Frame", "frame", frameCount);
+        double frameStart = TimerNow();
+        if (isHeadless){
+            glQueryCounter(timerQueries[0], GL_TIMESTAMP);
+        }
+        gpuTimers.BeginFrame(frameCount);
 
         glClearColor(viewer->imgui->color.x, viewer->imgui->color.y, viewer->imgui->color.z, viewer->imgui->color.w);
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glfwSwapInterval(viewer->imgui->VSync);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glfwWindowHint(GLFW_SAMPLES, 4);
+        if (!isHeadless){
+            glfwSwapInterval(viewer->imgui->VSync);
+            glfwWindowHint(GLFW_SAMPLES, 4);
+        }
 
         /* Wireframe mode */
         if(isEdgeDisplay){
@@ -284,144 +599,354 @@ int Display(HLOD &multiResModel, int maxLevel){
             glPolygonMode(GL_FRONT_AND_BACK, GL_POLYGON);
         }
 
-        /* Time recording for the mouse operation */
-        float currentFrame = glfwGetTime();
-        viewer->deltaTime = currentFrame - viewer->lastFrame;
-        viewer->lastFrame = currentFrame;
+        if (isHeadless){
+            cameraPath.Apply(frameCount - 1, *viewer->camera);
+        }
+        else{
+            /* Time recording for the mouse operation */
+            float currentFrame = glfwGetTime();
+            viewer->deltaTime = currentFrame - viewer->lastFrame;
+            viewer->lastFrame = currentFrame;
+
+            viewer->ProcessInput(viewer->window);
 
-        viewer->ProcessInput(viewer->window);
+            /* Camera path for the headless replay */
+            if (viewer->isRecordPath){
+                cameraPath.Append(*viewer->camera);
+            }
+            else if (cameraPath.Size()){
+                cameraPath.Save("./camera_path.txt");
+                cout << "Camera path of " << cameraPath.Size() << " frames saved to ./camera_path.txt" << endl;
+                cameraPath = CameraPath();
+            }
+        }
 
         /* Transformation matrix */
         Mat4 projection = viewer->camera->view_to_clip();
         Mat4 view = viewer->camera->world_to_view();
         Mat4 pvm = projection * view * model;
         /* Matrices uniform buffer */
+        Mat4 matrices[3] = {projection, view, model};
         glBindBuffer(GL_UNIFORM_BUFFER, uboMatices);
-        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Mat4), &(projection.cols[0]));
-        glBufferSubData(GL_UNIFORM_BUFFER, sizeof(Mat4), sizeof(Mat4), &(view.cols[0]));
-        glBufferSubData(GL_UNIFORM_BUFFER, 2 * sizeof(Mat4), sizeof(Mat4), &(model.cols[0]));
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(matrices), &(matrices[0].cols[0]));
         glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
-        /* Setting shaders */
-        shader->Use();
-        shader->SetFloat("params.kappa", viewer->imgui->kappa);
-        shader->SetFloat("params.sigma", viewer->imgui->sigma);
-        shader->SetVec3("params.vp", viewer->camera->position);
-        shader->SetVec3("params.freezeVp", freezeVp);
-        shader->SetBool("params.isFreezeFrame", viewer->isFreezeFrame);
-        shader->SetBool("params.isAdaptive", isAdaptive);
-        shader->SetInt("maxLevel", maxLevel);
-
-        /* Screen shot */
-        if (viewer->imgui->isSavePic){
-            string screen_shot_name = "./pic/" + to_string(frameCount) + ".tga";
-            SaveScreenshotToFile(screen_shot_name, viewer->width, viewer->height);
-            viewer->imgui->isSavePic = false;
+        glState.CountBufferUpdate();
+
+        /* The background build is done: its hierarchy replaces the proxy, streamed like the first model */
+        bool isModelSwapped = false;
+        if (build){
+            viewer->imgui->buildLevelCount = build->levelCount.load();
+            viewer->imgui->builtLevels = build->builtLevels.load();
+            HLOD *builtModel = build->Acquire();
+            if (builtModel){
+                pthread_mutex_lock(&worker->selectMutex);
+                worker->hlod = builtModel;
+                worker->maxLevel = maxLevel = build->maxLevel;
+                pthread_mutex_unlock(&worker->selectMutex);
+
+                /* A camera sample of the proxy is not selected on the new model */
+                pthread_mutex_lock(&worker->inputMutex);
+                worker->hasInput = false;
+                pthread_mutex_unlock(&worker->inputMutex);
+
+                ObjectBufferDestroy(vao);
+                uploader->Destroy();
+                delete uploader;
+                uploader = new GpuUploader();
+                uploader->Init();
+                ObjectBufferInit(*builtModel, maxLevel, *uploader);
+                BindVAOBuffer(vao);
+                uploadStart = TimerNow();
+                isUploadReported = false;
+
+                viewer->imgui->hlodTriCount = builtModel->data.idxCount / 3;
+                viewer->imgui->hlodVertexCount = builtModel->data.posCount;
+                viewer->imgui->buildLevelCount = 0;
+                build = NULL;
+                isModelSwapped = true;
+            }
         }
 
-        /* Select visible cubes */
-        if (viewer->isFreezeFrame){
-            renderStack = freezeRenderStack;
+        /* Stream the next slice of the model, the selection only refines into resident cubes */
+        double uploadTime = 0.0;
+        if (!uploader->IsDone()){
+            SC_TRACE_ZONE("Upload");
+            double stepStart = TimerNow();
+            uploader->Step();
+            uploadTime = (TimerNow() - stepStart) * 1000.0;
         }
-        else{
-            SelectCubeVisbility(multiResModel.lods, maxLevel, pvm, model);
+        if (uploader->IsDone() && !isUploadReported){
+            printf("Model resident on the GPU: %.2f MB in %.3f s\n", uploader->totalBytes / 1048576.0, TimerNow() - uploadStart);
+            vector<unsigned char>().swap(indexStream);
+            vector<MorphVertex>().swap(morphVertices);
+            isUploadReported = true;
         }
-
-        /* Store the stack for the freeze frame */
-        if (!viewer->isFreezeFrame){
-            freezeRenderStack = renderStack;
-            freezeVp = viewer->camera->position;
-        }
-
-        /* Render the current scene */
-        while (!renderStack.empty()){
-            int curLevel = renderStack.top().first;
-            uint64_t curCubeIdx = renderStack.top().second;
-            size_t indexOffset = multiResModel.lods[maxLevel - curLevel]->cubeTable[curCubeIdx].idxOffset * sizeof(uint32_t);
-            size_t vertexOffset = multiResModel.lods[maxLevel - curLevel]->cubeTable[curCubeIdx].vertexOffset * VERTEX_STRIDE;
-
-            /* Get the parent offset */
-            size_t parentOffset = 0;
-            if (curLevel != 0){
-                uint parentCoord[3];
-                parentCoord[0] = multiResModel.lods[maxLevel - curLevel]->cubeTable[curCubeIdx].coord[0] / 2;
-                parentCoord[1] = multiResModel.lods[maxLevel - curLevel]->cubeTable[curCubeIdx].coord[1] / 2;
-                parentCoord[2] = multiResModel.lods[maxLevel - curLevel]->cubeTable[curCubeIdx].coord[2] / 2;
-                uint64_t ijk_p = (uint64_t)(parentCoord[0]) | ((uint64_t)(parentCoord[1]) << 16) | ((uint64_t)(parentCoord[2]) << 32);
-                parentOffset = multiResModel.lods[maxLevel - curLevel + 1]->cubeTable[ijk_p].vertexOffset * VERTEX_STRIDE;
+        viewer->imgui->uploadProgress = uploader->totalBytes ? (float)uploader->uploadedBytes / uploader->totalBytes : 1.0f;
+
+        /* Select visible cubes, on the selection thread while this frame is drawn, the freeze frame keeps the last list */
+        if (!viewer->isFreezeFrame || isModelSwapped){
+            SelectionInput in;
+            in.pvm = pvm;
+            in.model = model;
+            in.viewpoint = viewer->camera->position;
+            in.modelScale = viewer->scale;
+            in.nearPlane = viewer->camera->get_near();
+            in.pixelScale = 0.5f * viewer->height * viewer->camera->frustum.aspect_y;
+            in.pixelError = viewer->imgui->pixelError;
+            in.sigma = viewer->imgui->sigma;
+            in.triangleBudget = viewer->imgui->triangleBudget;
+            in.isFrustumCulling = viewer->imgui->isFrustumCulling;
+            in.isTriangleBudget = viewer->imgui->isTriangleBudget;
+            in.isOcclusionCulling = viewer->imgui->isOcclusionCulling;
+            in.frame = frameCount;
+            in.sampleTime = TimerNow();
+            memcpy(in.residentCubes, uploader->residentCubes, sizeof(in.residentCubes));
+
+            if (viewer->imgui->isPipelined && !isModelSwapped){
+                PostSelection(worker, in);
             }
             else{
-                parentOffset = vertexOffset;
+                RunSelection(worker, in);
             }
+            worker->exchange.Acquire();
+        }
+        RenderList *drawList = worker->exchange.front;
+
+        /* Setting shaders, the list morphs from the viewpoint it was selected at so it stays crack free */
+        unsigned shaderFeatures = (isAdaptive ? SC_SHADER_ADAPTIVE : 0) |
+                                  (viewer->imgui->isSoomthShading ? SC_SHADER_SMOOTH_SHADING : 0) |
+                                  (isLodColorized ? SC_SHADER_LOD_COLOR : 0) |
+                                  (isCubeColorized ? SC_SHADER_CUBE_COLOR : 0);
+        shader = shaderVariants->Get(shaderFeatures);
+        shader->Use();
+        frameParams.vp[0] = viewer->camera->position.x;
+        frameParams.vp[1] = viewer->camera->position.y;
+        frameParams.vp[2] = viewer->camera->position.z;
+        frameParams.sigma = viewer->imgui->sigma;
+        frameParams.freezeVp[0] = drawList->viewpoint.x;
+        frameParams.freezeVp[1] = drawList->viewpoint.y;
+        frameParams.freezeVp[2] = drawList->viewpoint.z;
+        frameParams.maxLevel = maxLevel;
+        for (int l = 0; l < SC_MAX_LOD_LEVEL; ++l){
+            frameParams.kappa[l][0] = drawList->kappa[l];
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, uboFrame);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameParameters), &frameParams);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glState.CountBufferUpdate();
 
-            shader->Use();
-            glBindVertexArray(vao);
-            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pos);
-            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, nml);
-            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, uv);
-            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, clr);
-
-            shader->SetInt("parentBase", parentOffset / (3 * sizeof(float)));
-            shader->SetInt("level", multiResModel.lods[maxLevel - curLevel]->level);
-            shader->SetInt("coordX", multiResModel.lods[maxLevel - curLevel]->cubeTable[curCubeIdx].coord[0]);
-            shader->SetInt("coordY", multiResModel.lods[maxLevel - curLevel]->cubeTable[curCubeIdx].coord[1]);
-            shader->SetInt("coordZ", multiResModel.lods[maxLevel - curLevel]->cubeTable[curCubeIdx].coord[2]);
-            
-            glDrawElementsBaseVertex(GL_TRIANGLES,
-                                     multiResModel.lods[maxLevel - curLevel]->cubeTable[curCubeIdx].triangleCount * 3,
-                                     GL_UNSIGNED_INT,
-                                     (void *)(indexOffset),
-                                     vertexOffset / (3 * sizeof(float)));
+        /* Earlier captures that are ready go to the writers */
+        capture->Poll();
 
-            glBindVertexArray(0);
+        /* Render the current scene */
+        SC_TRACE_BEGIN(drawZone, "DrawSubmit");
+        double submitStart = TimerNow();
+        gpuTimers.Begin(SC_GPU_PASS_SCENE);
+        glState.BindVertexArray(vao);
+#ifndef SC_INTERLEAVED_VERTEX
+        glState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pos);
+        glState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, nml);
+#endif
+        glState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, uv);
+        glState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, clr);
+
+        /* One uniform per cube, by the location resolved at link time: level, parent base, colour index */
+        GLint cubeLocation = shader->Location("cube");
+        for (DrawRecord &record : drawList->records){
+            int *coord = record.cube->coord;
+            int colorIdx = (31 * record.level + 7 * coord[0] + 13 * coord[1] + 17 * coord[2]) & 7;
+            shader->SetIVec4(cubeLocation, record.level, (int)record.parentBase, colorIdx, 0);
 
-            /* Calculate the number of traingles */
-            renderedTriSum += multiResModel.lods[maxLevel - curLevel]->cubeTable[curCubeIdx].triangleCount * 3;
+            glDrawElementsBaseVertex(GL_TRIANGLES,
+                                     record.triangleCount * 3,
+                                     record.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+                                     (void *)record.idxByteOffset,
+                                     record.vertexOffset);
+            glState.CountDraw();
+        }
+        glState.BindVertexArray(0);
+        SC_TRACE_END(drawZone);
 
-            /* BBX render*/
-            if (isBbxDisplay){
-                bbxShader->Use();
-                bbxDrawer->Render(multiResModel.lods[maxLevel - curLevel]->cubeTable[curCubeIdx], bbxShader, multiResModel.lods[maxLevel - curLevel]->cubeLength, multiResModel.lods[maxLevel - curLevel]->level);
+        /* BBX render, one instanced draw for the whole list */
+        if (isBbxDisplay){
+            gpuTimers.Begin(SC_GPU_PASS_BBOX);
+            bbxDrawer->Render(*worker->hlod, *drawList, bbxShader);
+            shader->Use();
+        }
+        gpuTimers.End();
+        double submitTime = (TimerNow() - submitStart) * 1000.0;
+
+        /* Screen shot and frame recording, the scene without the UI */
+        if (!isHeadless){
+            if (viewer->imgui->isSavePic){
+                capture->Capture("./pic/" + to_string(frameCount) + ".tga", viewer->width, viewer->height, GL_BACK);
+                viewer->imgui->isSavePic = false;
             }
-
-            renderedCubeCount++;
-            renderStack.pop();
+            if (viewer->imgui->isRecordFrames){
+                char frameName[32];
+                snprintf(frameName, sizeof(frameName), "./pic/record_%05d.tga", recordFrameCount++);
+                capture->Capture(frameName, viewer->width, viewer->height, GL_BACK);
+            }
+            viewer->imgui->capturedCount = capture->capturedCount;
+            viewer->imgui->captureStallCount = capture->stallCount;
+            viewer->imgui->captureDroppedCount = capture->droppedCount;
         }
 
-        glfwSwapInterval(viewer->imgui->VSync);
+        /* Calculate the number of traingles */
+        renderedTriSum = drawList->triangleCount * 3;
+        renderedCubeCount = drawList->records.size();
 
         viewer->imgui->renderCubeCount = renderedCubeCount;
+        viewer->imgui->budgetScale = drawList->budgetScale;
+        viewer->imgui->occludedCubeCount = drawList->occludedCount;
+        viewer->imgui->occluderTriCount = drawList->occluderTriCount;
+        viewer->imgui->occlusionTime = drawList->occlusionTime;
+
+        /* Latency of the drawn list: frames and time since its camera sample */
+        viewer->imgui->selectionTime = drawList->selectionTime;
+        viewer->imgui->renderCpuTime = (TimerNow() - frameStart) * 1000.0;
+        viewer->imgui->latencyFrames = frameCount - drawList->frame;
+        viewer->imgui->latencyTime = (TimerNow() - drawList->sampleTime) * 1000.0;
         size_t renderedTriSum_tri = renderedTriSum / 3;
 
-        viewer->imgui->ImguiDraw(renderedTriSum_tri);
+        /* Frame breakdown, the GPU times are the ones of the last frame read back */
+        float metrics[SC_METRIC_COUNT];
+        metrics[SC_METRIC_FRAME] = lastFrameStart > 0.0 ? (frameStart - lastFrameStart) * 1000.0 : 0.0f;
+        metrics[SC_METRIC_CPU] = viewer->imgui->renderCpuTime;
+        metrics[SC_METRIC_SELECTION] = drawList->selectionTime;
+        metrics[SC_METRIC_LIST] = drawList->listTime;
+        metrics[SC_METRIC_UPLOAD] = uploadTime;
+        metrics[SC_METRIC_SUBMIT] = submitTime;
+        metrics[SC_METRIC_GPU_SCENE] = gpuTimers.passTime[SC_GPU_PASS_SCENE];
+        metrics[SC_METRIC_GPU_BBOX] = gpuTimers.passTime[SC_GPU_PASS_BBOX];
+        metrics[SC_METRIC_GPU_UI] = gpuTimers.passTime[SC_GPU_PASS_UI];
+        lastFrameStart = frameStart;
+        if (!isHeadless){
+            frameStats.Push(metrics);
+            viewer->imgui->gpuSkippedCount = gpuTimers.skippedCount;
+            if (viewer->imgui->isRecordData && !timings.IsOpen()){
+                viewer->imgui->isRecordData = timings.Open(viewer->imgui->telemetryFormat ? "telemetry.json" : "telemetry.csv",
+                                                           {"frame", "frame_ms", "cpu_ms", "selection_ms", "list_ms", "upload_ms", "submit_ms",
+                                                            "gpu_scene_ms", "gpu_bbox_ms", "gpu_ui_ms", "gpu_frame", "triangles", "cubes"});
+            }
+            else if (!viewer->imgui->isRecordData && timings.IsOpen()){
+                timings.Close();
+            }
+            if (timings.IsOpen()){
+                double row[] = {(double)frameCount, metrics[SC_METRIC_FRAME], metrics[SC_METRIC_CPU], metrics[SC_METRIC_SELECTION],
+                                metrics[SC_METRIC_LIST], metrics[SC_METRIC_UPLOAD], metrics[SC_METRIC_SUBMIT],
+                                metrics[SC_METRIC_GPU_SCENE], metrics[SC_METRIC_GPU_BBOX], metrics[SC_METRIC_GPU_UI],
+                                (double)gpuTimers.resultFrame, (double)drawList->triangleCount, (double)drawList->records.size()};
+                timings.Push(row);
+            }
+        }
+
+        if (!isHeadless){
+            viewer->imgui->ImguiDraw(renderedTriSum_tri);
+        }
         isBbxDisplay = viewer->imgui->isBBXVis;
         isEdgeDisplay = viewer->imgui->isWireframe;
         isLodColorized = viewer->imgui->isLODColor;
         isCubeColorized = viewer->imgui->isCubeColor;
         isAdaptive = viewer->imgui->isAdaptiveLOD;
 
-        shader->SetBool("isSmoothShading", viewer->imgui->isSoomthShading);
-        shader->SetBool("isLodColorized", isLodColorized);
-        shader->SetBool("isCubeColorized", isCubeColorized);
+        if (isHeadless){
+            if (headless->isSaveImage){
+                char imageName[32];
+                snprintf(imageName, sizeof(imageName), "/frame_%05d.png", frameCount - 1);
+                capture->Capture(headless->outputDir + imageName, offscreen.width, offscreen.height, GL_COLOR_ATTACHMENT0);
+            }
+
+            /* GPU timestamps, and the wall time the frame needs to complete: software rasterizers
+             * such as llvmpipe draw at the flush, their timestamps do not cover the rasterization */
+            gpuTimers.EndFrame();
+            glQueryCounter(timerQueries[1], GL_TIMESTAMP);
+            double cpuTime = viewer->imgui->renderCpuTime;
+            double finishStart = TimerNow();
+            SC_TRACE_BEGIN(finishZone, "Finish");
+            glFinish();
+            SC_TRACE_END(finishZone);
+            double finishTime = (TimerNow() - finishStart) * 1000.0;
+            GLuint64 gpuStart = 0, gpuEnd = 0;
+            glGetQueryObjectui64v(timerQueries[0], GL_QUERY_RESULT, &gpuStart);
+            glGetQueryObjectui64v(timerQueries[1], GL_QUERY_RESULT, &gpuEnd);
+            GLuint64 gpuTime = gpuEnd - gpuStart;
+            glCallSum.draws += glState.frame.draws;
+            glCallSum.uniforms += glState.frame.uniforms;
+            glCallSum.binds += glState.frame.binds;
+            glCallSum.droppedBinds += glState.frame.droppedBinds;
+            glCallSum.programs += glState.frame.programs;
+            cpuTimeSum += cpuTime;
+            gpuTimeSum += gpuTime / 1000000.0;
+            finishTimeSum += finishTime;
+
+            /* The pass queries of this frame are done after the finish */
+            gpuTimers.Collect();
+            double row[] = {(double)frameCount - 1, cpuTime, gpuTime / 1000000.0, finishTime, drawList->selectionTime,
+                            (double)drawList->triangleCount, (double)drawList->records.size(),
+                            drawList->listTime, uploadTime, submitTime,
+                            gpuTimers.passTime[SC_GPU_PASS_SCENE], gpuTimers.passTime[SC_GPU_PASS_BBOX]};
+            timings.Push(row);
+            continue;
+        }
 
         /* Imgui rendering */
+        gpuTimers.Begin(SC_GPU_PASS_UI);
         viewer->imgui->ImguiRender();
+        gpuTimers.EndFrame();
 
+        SC_TRACE_BEGIN(swapZone, "SwapBuffers");
         glfwSwapBuffers(viewer->window);
+        SC_TRACE_END(swapZone);
         glfwPollEvents();
     }
 
-    viewer->imgui->ImguiClean();
-
-    glDeleteVertexArrays(1, &vao);
-    glDeleteBuffers(1, &pos);
-    glDeleteBuffers(1, &idx);
-    glDeleteBuffers(1, &remap);
-    glDeleteBuffers(1, &nml);
-    glDeleteBuffers(1, &uv);
-    glDeleteBuffers(1, &clr);
+    capture->Destroy();
+    delete capture;
+    bbxDrawer->Destroy();
+    delete bbxDrawer;
+    shaderVariants->Destroy();
+    delete shaderVariants;
+    uploader->Destroy();
+    delete uploader;
+    timings.Close();
+    gpuTimers.Destroy();
+    glDeleteBuffers(1, &uboMatices);
+    glDeleteBuffers(1, &uboFrame);
+
+    if (isHeadless){
+        if (frameCount){
+            printf("Headless: %d frames, average CPU %.3f ms, GPU %.3f ms, finish %.3f ms\n", frameCount, cpuTimeSum / frameCount, gpuTimeSum / frameCount, finishTimeSum / frameCount);
+            printf("GL calls per frame: %.1f draws, %.1f uniforms, %.1f binds (%.1f dropped), %.1f programs\n", (double)glCallSum.draws / frameCount,
+                   (double)glCallSum.uniforms / frameCount, (double)glCallSum.binds / frameCount, (double)glCallSum.droppedBinds / frameCount,
+                   (double)glCallSum.programs / frameCount);
+        }
+        glDeleteQueries(2, timerQueries);
+        offscreen.Destroy();
+    }
+    else{
+        viewer->imgui->ImguiClean();
+    }
 
-    glfwTerminate();
+    pthread_mutex_lock(&worker->inputMutex);
+    worker->isRunning = false;
+    pthread_cond_signal(&worker->inputCond);
+    pthread_mutex_unlock(&worker->inputMutex);
+    pthread_join(worker->thread, NULL);
+    pthread_cond_destroy(&worker->inputCond);
+    pthread_mutex_destroy(&worker->selectMutex);
+    pthread_mutex_destroy(&worker->inputMutex);
+    delete worker;
+    delete occlusionCuller;
+
+    ObjectBufferDestroy(vao);
+
+    if (isHeadless){
+        DestroyHeadlessContext();
+    }
+    else{
+        glfwTerminate();
+    }
 
     return 0;
 }
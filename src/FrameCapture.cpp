@@ -0,0 +1,221 @@
+#include <cstring>
+#include <iostream>
+#include "FrameCapture.h"
+#include "stb_image_write.h"
+#include "Trace.h"
+
+static void *WriteParallel(void *arg)
+{
+    return ((FrameCapture *)arg)->WriteLoop();
+}
+
+void FrameCapture::Init()
+{
+    for (int i = 0; i < SC_CAPTURE_RING; ++i)
+    {
+        glGenBuffers(1, &slots[i].pbo);
+    }
+
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&jobCond, NULL);
+    pthread_cond_init(&doneCond, NULL);
+    isRunning = true;
+    for (int i = 0; i < SC_CAPTURE_WRITERS; ++i)
+    {
+        pthread_create(&writers[i], NULL, WriteParallel, (void *)this);
+    }
+}
+
+void FrameCapture::Capture(const string &file, int width, int height, GLenum readBuffer)
+{
+    /* Ring full: the oldest frame has to leave before this one is read */
+    if (inFlight == SC_CAPTURE_RING)
+    {
+        stallCount++;
+        Retire(true);
+    }
+
+    CaptureSlot &slot = slots[(head + inFlight) % SC_CAPTURE_RING];
+    size_t size = (size_t)width * height * 3;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    if (slot.size != size)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        slot.size = size;
+    }
+
+    /* The copy into the PBO is queued, glReadPixels returns at once */
+    glReadBuffer(readBuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.file = file;
+    slot.width = width;
+    slot.height = height;
+    inFlight++;
+}
+
+void FrameCapture::Poll()
+{
+    while (inFlight && Retire(false))
+    {
+    }
+}
+
+bool FrameCapture::Retire(bool isWait)
+{
+    CaptureSlot &slot = slots[head];
+    GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, isWait ? GL_TIMEOUT_IGNORED : 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+        return false;
+    }
+
+    /* A free pixel buffer, or wait for a writer when too many frames are queued */
+    CaptureJob *job = NULL;
+    pthread_mutex_lock(&mutex);
+    if (!isWait && jobs.size() >= SC_CAPTURE_QUEUE)
+    {
+        pthread_mutex_unlock(&mutex);
+        return false;
+    }
+    while (jobs.size() >= SC_CAPTURE_QUEUE)
+    {
+        pthread_cond_wait(&doneCond, &mutex);
+    }
+    if (!freeJobs.empty())
+    {
+        job = freeJobs.back();
+        freeJobs.pop_back();
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if (!job)
+    {
+        job = new CaptureJob;
+    }
+    job->file = slot.file;
+    job->width = slot.width;
+    job->height = slot.height;
+    job->pixels.resize(slot.size);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+    if (data)
+    {
+        memcpy(job->pixels.data(), data, slot.size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        capturedCount++;
+    }
+    else
+    {
+        cout << "Failed to map the readback of " << slot.file << ", frame dropped" << endl;
+        droppedCount++;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+    head = (head + 1) % SC_CAPTURE_RING;
+    inFlight--;
+
+    pthread_mutex_lock(&mutex);
+    if (data)
+    {
+        jobs.push_back(job);
+        pthread_cond_signal(&jobCond);
+    }
+    else
+    {
+        freeJobs.push_back(job);
+    }
+    pthread_mutex_unlock(&mutex);
+    return true;
+}
+
+void *FrameCapture::WriteLoop()
+{
+    /* Only the writers call stb_image_write, its flip flag is global */
+    stbi_flip_vertically_on_write(1);
+    SC_TRACE_THREAD("capture writer");
+
+    while (true)
+    {
+        pthread_mutex_lock(&mutex);
+        while (jobs.empty() && isRunning)
+        {
+            pthread_cond_wait(&jobCond, &mutex);
+        }
+        if (jobs.empty())
+        {
+            pthread_mutex_unlock(&mutex);
+            break;
+        }
+        CaptureJob *job = jobs.front();
+        jobs.pop_front();
+        busyWriters++;
+        pthread_mutex_unlock(&mutex);
+
+        SC_TRACE_BEGIN(encodeZone, "EncodeFrame");
+        bool isPng = job->file.size() > 4 && job->file.compare(job->file.size() - 4, 4, ".png") == 0;
+        int ok = isPng ? stbi_write_png(job->file.c_str(), job->width, job->height, 3, job->pixels.data(), job->width * 3)
+                       : stbi_write_tga(job->file.c_str(), job->width, job->height, 3, job->pixels.data());
+        if (!ok)
+        {
+            cout << "Failed to write " << job->file << endl;
+        }
+        SC_TRACE_END(encodeZone);
+
+        pthread_mutex_lock(&mutex);
+        freeJobs.push_back(job);
+        busyWriters--;
+        pthread_cond_broadcast(&doneCond);
+        pthread_mutex_unlock(&mutex);
+    }
+    return NULL;
+}
+
+void FrameCapture::Flush()
+{
+    while (inFlight)
+    {
+        Retire(true);
+    }
+
+    pthread_mutex_lock(&mutex);
+    while (!jobs.empty() || busyWriters)
+    {
+        pthread_cond_wait(&doneCond, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+void FrameCapture::Destroy()
+{
+    Flush();
+
+    pthread_mutex_lock(&mutex);
+    isRunning = false;
+    pthread_cond_broadcast(&jobCond);
+    pthread_mutex_unlock(&mutex);
+    for (int i = 0; i < SC_CAPTURE_WRITERS; ++i)
+    {
+        pthread_join(writers[i], NULL);
+    }
+
+    for (CaptureJob *job : freeJobs)
+    {
+        delete job;
+    }
+    freeJobs.clear();
+
+    for (int i = 0; i < SC_CAPTURE_RING; ++i)
+    {
+        glDeleteBuffers(1, &slots[i].pbo);
+    }
+    pthread_cond_destroy(&doneCond);
+    pthread_cond_destroy(&jobCond);
+    pthread_mutex_destroy(&mutex);
+}
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <cstring>
+#include "FrameStats.h"
+
+using namespace std;
+
+const char *frameMetricNames[SC_METRIC_COUNT] = {"frame", "render CPU", "selection", "list build", "upload",
+                                                 "submission", "GPU scene", "GPU boxes", "GPU UI"};
+
+void GpuTimerRing::Init()
+{
+    glGenQueries(SC_GPU_TIMER_RING * SC_GPU_PASS_COUNT, &queries[0][0]);
+}
+
+void GpuTimerRing::Destroy()
+{
+    glDeleteQueries(SC_GPU_TIMER_RING * SC_GPU_PASS_COUNT, &queries[0][0]);
+}
+
+void GpuTimerRing::BeginFrame(int frame)
+{
+    Collect();
+
+    isTiming = inFlight < SC_GPU_TIMER_RING;
+    if (!isTiming)
+    {
+        skippedCount++;
+        return;
+    }
+    int slot = (head + inFlight) % SC_GPU_TIMER_RING;
+    memset(isIssued[slot], 0, sizeof(isIssued[slot]));
+    frames[slot] = frame;
+}
+
+void GpuTimerRing::EndFrame()
+{
+    End();
+    if (isTiming)
+    {
+        inFlight++;
+        isTiming = false;
+    }
+}
+
+void GpuTimerRing::Begin(GpuPass pass)
+{
+    End();
+    if (!isTiming)
+    {
+        return;
+    }
+    int slot = (head + inFlight) % SC_GPU_TIMER_RING;
+    glBeginQuery(GL_TIME_ELAPSED, queries[slot][pass]);
+    isIssued[slot][pass] = true;
+    activePass = pass;
+}
+
+void GpuTimerRing::End()
+{
+    if (activePass >= 0)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        activePass = -1;
+    }
+}
+
+bool GpuTimerRing::Collect()
+{
+    bool isCollected = false;
+    while (inFlight)
+    {
+        for (int p = 0; p < SC_GPU_PASS_COUNT; ++p)
+        {
+            GLint isAvailable = GL_TRUE;
+            if (isIssued[head][p])
+            {
+                glGetQueryObjectiv(queries[head][p], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+            }
+            if (!isAvailable)
+            {
+                return isCollected;
+            }
+        }
+
+        /* A pass not drawn that frame counts as zero */
+        for (int p = 0; p < SC_GPU_PASS_COUNT; ++p)
+        {
+            GLuint64 elapsed = 0;
+            if (isIssued[head][p])
+            {
+                glGetQueryObjectui64v(queries[head][p], GL_QUERY_RESULT, &elapsed);
+            }
+            passTime[p] = elapsed / 1000000.0f;
+        }
+        resultFrame = frames[head];
+        head = (head + 1) % SC_GPU_TIMER_RING;
+        inFlight--;
+        isCollected = true;
+    }
+    return isCollected;
+}
+
+void FrameStats::Push(const float *values)
+{
+    for (int m = 0; m < SC_METRIC_COUNT; ++m)
+    {
+        history[m][offset] = values[m];
+        latest[m] = values[m];
+    }
+    offset = (offset + 1) % SC_FRAME_HISTORY;
+    count = min(count + 1, SC_FRAME_HISTORY);
+}
+
+float FrameStats::Percentile(FrameMetric metric, float p) const
+{
+    if (!count)
+    {
+        return 0.0f;
+    }
+    /* Until the history is full its values are the first count slots */
+    float sorted[SC_FRAME_HISTORY];
+    memcpy(sorted, history[metric], count * sizeof(float));
+    int k = min(count - 1, (int)(p * (count - 1) + 0.5f));
+    nth_element(sorted, sorted + k, sorted + count);
+    return sorted[k];
+}
+
+int FrameStats::Sorted(FrameMetric metric, float *values) const
+{
+    memcpy(values, history[metric], count * sizeof(float));
+    sort(values, values + count);
+    return count;
+}
@@ -0,0 +1,59 @@
+#include <cstring>
+#include "GlState.h"
+
+GlState glState;
+
+void GlState::UseProgram(GLuint id)
+{
+    if (program == id)
+    {
+        frame.droppedBinds++;
+        return;
+    }
+    glUseProgram(id);
+    program = id;
+    frame.programs++;
+}
+
+void GlState::BindVertexArray(GLuint id)
+{
+    if (vao == id)
+    {
+        frame.droppedBinds++;
+        return;
+    }
+    glBindVertexArray(id);
+    vao = id;
+    frame.binds++;
+}
+
+void GlState::BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    GLuint *bindings = target == GL_UNIFORM_BUFFER ? uniformBuffers : (target == GL_SHADER_STORAGE_BUFFER ? storageBuffers : NULL);
+    if (bindings && index < (GLuint)SC_GL_BINDINGS)
+    {
+        if (bindings[index] == buffer)
+        {
+            frame.droppedBinds++;
+            return;
+        }
+        bindings[index] = buffer;
+    }
+    glBindBufferBase(target, index, buffer);
+    frame.binds++;
+}
+
+void GlState::EndFrame()
+{
+    last = frame;
+    frame = GlCallCounters();
+}
+
+void GlState::Invalidate()
+{
+    /* Zero is a valid binding, the shadow must not match anything until the next bind */
+    program = ~0u;
+    vao = ~0u;
+    memset(storageBuffers, 0xff, sizeof(storageBuffers));
+    memset(uniformBuffers, 0xff, sizeof(uniformBuffers));
+}
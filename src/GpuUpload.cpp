@@ -0,0 +1,132 @@
+#include <cstring>
+#include <iostream>
+#include "GpuUpload.h"
+
+bool GpuUploader::Init()
+{
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &staging);
+    glBindBuffer(GL_COPY_READ_BUFFER, staging);
+    glBufferStorage(GL_COPY_READ_BUFFER, SC_UPLOAD_RING * SC_UPLOAD_SLICE, NULL, flags);
+    mapped = (unsigned char *)glMapBufferRange(GL_COPY_READ_BUFFER, 0, SC_UPLOAD_RING * SC_UPLOAD_SLICE, flags);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    if (!mapped)
+    {
+        cout << "Failed to map the upload staging buffer" << endl;
+        return false;
+    }
+    return true;
+}
+
+GLuint GpuUploader::CreateBuffer(size_t size)
+{
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, max(size, (size_t)4), NULL, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return buffer;
+}
+
+void GpuUploader::Add(GLuint buffer, size_t offset, const void *data, size_t size)
+{
+    if (size)
+    {
+        ranges.push_back({buffer, offset, size, (const unsigned char *)data, -1});
+        totalBytes += size;
+    }
+}
+
+void GpuUploader::EndCube(int lodIdx)
+{
+    /* A cube without data is still counted, with an empty range */
+    if (ranges.empty() || ranges.back().lodIdx >= 0)
+    {
+        ranges.push_back({0, 0, 0, NULL, lodIdx});
+        return;
+    }
+    ranges.back().lodIdx = lodIdx;
+}
+
+bool GpuUploader::Step()
+{
+    if (IsDone())
+    {
+        return false;
+    }
+
+    /* The slice was last used SC_UPLOAD_RING steps ago, do not stall the frame if the GPU is behind */
+    if (fences[slice])
+    {
+        if (glClientWaitSync(fences[slice], 0, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            return true;
+        }
+        glDeleteSync(fences[slice]);
+        fences[slice] = 0;
+    }
+
+    size_t sliceOffset = slice * SC_UPLOAD_SLICE;
+    size_t used = 0;
+    glBindBuffer(GL_COPY_READ_BUFFER, staging);
+    while (cursor < ranges.size() && used < SC_UPLOAD_SLICE)
+    {
+        UploadRange &range = ranges[cursor];
+        size_t size = min(range.size - rangeDone, SC_UPLOAD_SLICE - used);
+        if (size)
+        {
+            memcpy(mapped + sliceOffset + used, range.data + rangeDone, size);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, range.buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sliceOffset + used, range.offset + rangeDone, size);
+            used += size;
+            rangeDone += size;
+        }
+
+        /* Copies are ordered before the draws of the frame, the cube can be selected from now on */
+        if (rangeDone == range.size)
+        {
+            if (range.lodIdx >= 0)
+            {
+                residentCubes[range.lodIdx]++;
+            }
+            cursor++;
+            rangeDone = 0;
+        }
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    uploadedBytes += used;
+    fences[slice] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slice = (slice + 1) % SC_UPLOAD_RING;
+    return !IsDone();
+}
+
+void GpuUploader::Flush()
+{
+    while (!IsDone())
+    {
+        if (fences[slice])
+        {
+            glClientWaitSync(fences[slice], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        }
+        Step();
+    }
+}
+
+void GpuUploader::Destroy()
+{
+    for (int i = 0; i < SC_UPLOAD_RING; ++i)
+    {
+        if (fences[i])
+        {
+            glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, staging);
+    glUnmapBuffer(GL_COPY_READ_BUFFER);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glDeleteBuffers(1, &staging);
+    vector<UploadRange>().swap(ranges);
+}
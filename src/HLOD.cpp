@@ -1,4 +1,6 @@
 #include "HLOD.h"
+#include "CpuDispatch.h"
+#include "Trace.h"
 
 HLOD::HLOD() : curIdxOffset(0), curVertOffset(0) {}
 
@@ -8,16 +10,14 @@ void HLOD::BuildLODFromInput(Mesh *rawMesh, size_t vertCount, size_t triCount)
     clock_t start, end;
 
     TimerStart();
-    for (int i = 0; i < vertCount * 3; i = i + 3)
-    {
-        GetMaxMin(rawMesh->positions[i], rawMesh->positions[i + 1], rawMesh->positions[i + 2], min, max);
-    }
+    cpuKernels.bounds(rawMesh->positions, vertCount, min, max);
     TimerStop("Bounding box computing time: ");
 
     /* Set LOD information */
     lods[0]->SetLOD(max, min);
 
     start = clock();
+    SC_TRACE_BEGIN(dispatchZone, "DispatchTriangles");
     /* Dispatch the traingle */
     uint64_t *triangleToCube = (uint64_t *)malloc(sizeof(uint64_t) * triCount);
     for (size_t i = 0; i < triCount * 3; i += 3)
@@ -37,33 +37,58 @@ void HLOD::BuildLODFromInput(Mesh *rawMesh, size_t vertCount, size_t triCount)
         /* Dispatch the triangle */
         Dispatch(coord, lods[0]->cubeTable);
 
-        uint64_t coord64 = (uint64_t)(coord[0]) | ((uint64_t)(coord[1]) << 16) | ((uint64_t)(coord[2]) << 32);
+        /* The level of the cube is kept in the bits 48-63 */
+        uint64_t coord64 = PackCoord(coord[0], coord[1], coord[2]) | ((uint64_t)(lods[0]->level) << 48);
         triangleToCube[i / 3] = coord64;
     }
+    SC_TRACE_END(dispatchZone);
     end = clock();
     std::cout << "dispatch time : " << double(end - start) / CLOCKS_PER_SEC << endl;
 
+    /* Leaf cubes at varying depths */
+    if (leafTriBudget)
+    {
+        AdaptiveSubdivision(triangleToCube, triCount);
+    }
+
+    int leafDepth = lods[0]->level;
+    for (int l = 1; l <= leafDepth; ++l)
+    {
+        if (!lods[l])
+        {
+            lods[l] = new LOD(leafDepth - l);
+            lods[l]->SetLOD(max, min);
+        }
+    }
+
     /* Allocate vertex attributes memory space for each cube */
     size_t totalIndexCount = 0;
-    for (auto &cube : lods[0]->cubeTable)
+    for (int l = 0; l <= leafDepth; ++l)
     {
-        cube.second.idxOffset = totalIndexCount;
-        totalIndexCount += cube.second.triangleCount * 3;
+        for (auto &cube : lods[l]->cubeTable)
+        {
+            cube.second.idxOffset = totalIndexCount;
+            totalIndexCount += cube.second.triangleCount * 3;
+        }
     }
 
     /* Allocate memory for indices */
     data.indices = (uint32_t *)malloc(totalIndexCount * sizeof(uint32_t));
 
     /* Reset triangle count to zero */
-    for (auto &cube : lods[0]->cubeTable)
+    for (int l = 0; l <= leafDepth; ++l)
     {
-        cube.second.triangleCount = 0;
+        for (auto &cube : lods[l]->cubeTable)
+        {
+            cube.second.triangleCount = 0;
+        }
     }
 
     /* Fill the indices for each cube */
     for (size_t i = 0; i < triCount; ++i)
     {
-        Cube &cube = lods[0]->cubeTable[triangleToCube[i]];
+        int level = int(triangleToCube[i] >> 48);
+        Cube &cube = lods[leafDepth - level]->cubeTable[AncestorCoord(triangleToCube[i], 0)];
         size_t idxOffset = cube.idxOffset + 3 * cube.triangleCount;
         uint32_t *dst = data.indices + idxOffset;
         memcpy(dst, &rawMesh->indices[3 * i], 3 * sizeof(uint32_t));
@@ -82,9 +107,13 @@ void HLOD::BuildLODFromInput(Mesh *rawMesh, size_t vertCount, size_t triCount)
     /* Generate the unique vertices buffer and the compact index buffer for each cube */
     start = clock();
     size_t maxIdxCount = 0;
-    for (auto &cb : lods[0]->cubeTable)
+    for (int l = 0; l <= leafDepth; ++l)
     {
-        maxIdxCount = maxIdxCount > 3 * cb.second.triangleCount ? maxIdxCount : 3 * cb.second.triangleCount;
+        for (auto &cb : lods[l]->cubeTable)
+        {
+            size_t idxCount = 3 * (size_t)cb.second.triangleCount;
+            maxIdxCount = maxIdxCount > idxCount ? maxIdxCount : idxCount;
+        }
     }
 
     /* Allocate the data based on the max index count and vertex count */
@@ -96,73 +125,81 @@ void HLOD::BuildLODFromInput(Mesh *rawMesh, size_t vertCount, size_t triCount)
 
     /* Reindex the data of each cube */
     size_t totalVertCount = 0;
-    for (auto &cube : lods[0]->cubeTable)
+    for (int l = 0; l <= leafDepth; ++l)
     {
-        size_t cubeIdxOffset = cube.second.idxOffset;
-
-        memset(remap, 0, maxIdxCount * sizeof(uint32_t));
-
-        /* Position */
-        for (int i = 0; i < cube.second.triangleCount * 3; ++i)
+        for (auto &cube : lods[l]->cubeTable)
         {
-            memcpy(verts + 3 * i, &rawMesh->positions[3 * data.indices[cubeIdxOffset + i]], VERTEX_STRIDE);
-        }
+            size_t cubeIdxOffset = cube.second.idxOffset;
 
-        /* Normal */
-        for (int i = 0; i < cube.second.triangleCount * 3; ++i)
-        {
-            memcpy(normals + 3 * i, &rawMesh->normals[3 * data.indices[cubeIdxOffset + i]], VERTEX_STRIDE);
-        }
+            memset(remap, 0, maxIdxCount * sizeof(uint32_t));
 
-        /* Assigne index value */
-        for (int i = 0; i < cube.second.triangleCount * 3; ++i)
-        {
-            data.indices[cubeIdxOffset + i] = i;
-        }
+            /* Position */
+            for (int i = 0; i < cube.second.triangleCount * 3; ++i)
+            {
+                memcpy(verts + 3 * i, &rawMesh->positions[3 * data.indices[cubeIdxOffset + i]], VERTEX_STRIDE);
+            }
 
-        /* Re-organize vertex */
-        int vertCount = cube.second.triangleCount * 3;
-        int uniqueVertCount = meshopt_generateVertexRemap(remap, &data.indices[cubeIdxOffset], vertCount, verts, vertCount, VERTEX_STRIDE);
-        meshopt_remapVertexBuffer(uniqueVerts, verts, vertCount, VERTEX_STRIDE, remap);
-        meshopt_remapVertexBuffer(uniqueNormals, normals, vertCount, VERTEX_STRIDE, remap);
+            /* Normal */
+            for (int i = 0; i < cube.second.triangleCount * 3; ++i)
+            {
+                memcpy(normals + 3 * i, &rawMesh->normals[3 * data.indices[cubeIdxOffset + i]], VERTEX_STRIDE);
+            }
 
-        size_t new_index_count = 0;
-        for (size_t i = 0; i < cube.second.triangleCount * 3; i += 3)
-        {
-            uint32_t i0 = remap[data.indices[cubeIdxOffset + i]];
-            uint32_t i1 = remap[data.indices[cubeIdxOffset + i + 1]];
-            uint32_t i2 = remap[data.indices[cubeIdxOffset + i + 2]];
+            /* Assigne index value */
+            for (int i = 0; i < cube.second.triangleCount * 3; ++i)
+            {
+                data.indices[cubeIdxOffset + i] = i;
+            }
+
+            /* Re-organize vertex */
+            int vertCount = cube.second.triangleCount * 3;
+            int uniqueVertCount = meshopt_generateVertexRemap(remap, &data.indices[cubeIdxOffset], vertCount, verts, vertCount, VERTEX_STRIDE);
+            meshopt_remapVertexBuffer(uniqueVerts, verts, vertCount, VERTEX_STRIDE, remap);
+            meshopt_remapVertexBuffer(uniqueNormals, normals, vertCount, VERTEX_STRIDE, remap);
 
-            if (i0 != i1 && i0 != i2 && i1 != i2)
+            size_t new_index_count = 0;
+            for (size_t i = 0; i < (size_t)vertCount; i += 3)
             {
-                data.indices[cubeIdxOffset + new_index_count + 0] = i0;
-                data.indices[cubeIdxOffset + new_index_count + 1] = i1;
-                data.indices[cubeIdxOffset + new_index_count + 2] = i2;
-                new_index_count += 3;
+                uint32_t i0 = remap[data.indices[cubeIdxOffset + i]];
+                uint32_t i1 = remap[data.indices[cubeIdxOffset + i + 1]];
+                uint32_t i2 = remap[data.indices[cubeIdxOffset + i + 2]];
+
+                if (i0 != i1 && i0 != i2 && i1 != i2)
+                {
+                    data.indices[cubeIdxOffset + new_index_count + 0] = i0;
+                    data.indices[cubeIdxOffset + new_index_count + 1] = i1;
+                    data.indices[cubeIdxOffset + new_index_count + 2] = i2;
+                    new_index_count += 3;
+                }
             }
-        }
 
-        /* Copy data */
-        size_t vertexOffset = totalVertCount;
-        size_t vertexBufferSize = totalVertCount + uniqueVertCount;
+            /* Copy data */
+            size_t vertexOffset = totalVertCount;
+            size_t vertexBufferSize = totalVertCount + uniqueVertCount;
 
-        /* Reallocate data */
-        data.normals = (float *)realloc(data.normals, vertexBufferSize * VERTEX_STRIDE);
-        data.positions = (float *)realloc(data.positions, vertexBufferSize * VERTEX_STRIDE);
+            /* Reallocate data */
+            data.normals = (float *)realloc(data.normals, vertexBufferSize * VERTEX_STRIDE);
+            data.positions = (float *)realloc(data.positions, vertexBufferSize * VERTEX_STRIDE);
 
-        memcpy(&data.positions[3 * vertexOffset], uniqueVerts, VERTEX_STRIDE * uniqueVertCount);
-        memcpy(&data.normals[3 * vertexOffset], uniqueNormals, VERTEX_STRIDE * uniqueVertCount);
+            memcpy(&data.positions[3 * vertexOffset], uniqueVerts, VERTEX_STRIDE * uniqueVertCount);
+            memcpy(&data.normals[3 * vertexOffset], uniqueNormals, VERTEX_STRIDE * uniqueVertCount);
 
-        /* Update the vertex count */
-        cube.second.vertCount = uniqueVertCount;
-        cube.second.vertexOffset = vertexOffset;
+            /* Update the vertex count */
+            cube.second.vertCount = uniqueVertCount;
+            cube.second.vertexOffset = vertexOffset;
 
-        totalVertCount += uniqueVertCount;
-        cube.second.triangleCount = new_index_count / 3;
+            totalVertCount += uniqueVertCount;
+            cube.second.triangleCount = new_index_count / 3;
 
-        /* Compute the Cube bottom point assign the coord to the bounding box and the cube */
-        cube.second.ComputeBottomVertex(cube.second.bottom, cube.second.coord, lods[0]->cubeLength, min);
-        cube.second.coord64 = cube.first;
+            /* Compute the Cube bottom point assign the coord to the bounding box and the cube */
+            cube.second.ComputeBottomVertex(cube.second.bottom, cube.second.coord, lods[l]->cubeLength, min);
+            cube.second.coord64 = cube.first;
+            cube.second.isLeaf = true;
+            cube.second.ComputeTightBounds(uniqueVerts, uniqueVertCount, NULL, 0);
+
+            leafTriCount += cube.second.triangleCount;
+            leafVertCount += uniqueVertCount;
+        }
     }
     end = clock();
 
@@ -191,3 +228,184 @@ void HLOD::BuildLODFromInput(Mesh *rawMesh, size_t vertCount, size_t triCount)
     MemoryFree(uniqueVerts);
     MemoryFree(uniqueNormals);
 }
+
+void HLOD::AdaptiveSubdivision(uint64_t *triangleToCube, size_t triCount)
+{
+    int depth = lods[0]->level;
+
+    /* Triangle count of the occupied cubes of each level, accumulated from the finest grid */
+    vector<unordered_map<uint64_t, size_t>> counts(depth + 1);
+    for (auto &cube : lods[0]->cubeTable)
+    {
+        counts[depth][cube.first] = cube.second.triangleCount;
+    }
+    for (int l = depth; l > 0; --l)
+    {
+        for (auto &c : counts[l])
+        {
+            counts[l - 1][AncestorCoord(c.first, 1)] += c.second;
+        }
+    }
+
+    /* Top-down, a cube is split only if it is over budget: find the leaf level of each finest cube */
+    unordered_map<uint64_t, int> leafLevel;
+    int leafDepth = 0;
+    for (auto &cube : lods[0]->cubeTable)
+    {
+        int l = std::min((int)SC_MIN_LOD_LEVEL, depth);
+        while (l < depth && counts[l][AncestorCoord(cube.first, depth - l)] > leafTriBudget)
+        {
+            l++;
+        }
+        leafLevel[cube.first] = l;
+        leafDepth = std::max(leafDepth, l);
+    }
+
+    /* Rebuild the cube tables with the leaf cubes only */
+    delete lods[0];
+    for (int l = 0; l <= leafDepth; ++l)
+    {
+        lods[l] = new LOD(leafDepth - l);
+        lods[l]->SetLOD(max, min);
+    }
+
+    for (size_t i = 0; i < triCount; ++i)
+    {
+        uint64_t coord64 = AncestorCoord(triangleToCube[i], 0);
+        int level = leafLevel[coord64];
+        coord64 = AncestorCoord(coord64, depth - level);
+
+        int coord[3] = {int(coord64 & 0xFFFF), int((coord64 >> 16) & 0xFFFF), int((coord64 >> 32) & 0xFFFF)};
+        Dispatch(coord, lods[leafDepth - level]->cubeTable);
+
+        triangleToCube[i] = coord64 | ((uint64_t)(level) << 48);
+    }
+
+    cout << "adaptive subdivision depth: " << leafDepth << endl;
+}
+
+void HLOD::LinkCubes(int maxLevel)
+{
+    lods[maxLevel]->cubeArray.clear();
+    for (auto &cb : lods[maxLevel]->cubeTable)
+    {
+        lods[maxLevel]->cubeArray.push_back(&cb.second);
+    }
+
+    /* The children of each parent are appended in octant order, the parents in the order of their array */
+    for (int l = maxLevel; l > 0; --l)
+    {
+        LOD *mg = lods[l];
+        LOD *childMg = lods[l - 1];
+        childMg->cubeArray.clear();
+        childMg->cubeArray.reserve(childMg->cubeTable.size());
+
+        for (size_t p = 0; p < mg->cubeArray.size(); ++p)
+        {
+            Cube *parent = mg->cubeArray[p];
+            parent->childIdx = (int)childMg->cubeArray.size();
+
+            for (int oct = 0; oct < 8; ++oct)
+            {
+                if (!(parent->childMask & (1 << oct)))
+                {
+                    continue;
+                }
+
+                uint64_t coord = PackCoord(parent->coord[0] * 2 + (oct >> 2), parent->coord[1] * 2 + ((oct >> 1) & 1), parent->coord[2] * 2 + (oct & 1));
+                auto child = childMg->cubeTable.find(coord);
+                if (child == childMg->cubeTable.end())
+                {
+                    continue;
+                }
+                child->second.parentIdx = (int)p;
+                childMg->cubeArray.push_back(&child->second);
+            }
+        }
+
+        if (childMg->cubeArray.size() != childMg->cubeTable.size())
+        {
+            cout << "LOD " << childMg->level << ": " << childMg->cubeTable.size() - childMg->cubeArray.size() << " cubes without parent" << endl;
+        }
+    }
+}
+
+/* Normal to snorm 2_10_10_10, normalized first so that the 10 bits hold the direction */
+static uint32_t PackNormal(const float *normal)
+{
+    float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    float scale = length > 0.0f ? 511.0f / length : 0.0f;
+    uint32_t packed = 0;
+    for (int k = 0; k < 3; ++k)
+    {
+        int value = (int)lroundf(normal[k] * scale);
+        packed |= ((uint32_t)min(max(value, -511), 511) & 0x3FF) << (10 * k);
+    }
+    return packed;
+}
+
+void HLOD::BuildMorphVertices(int maxLevel, MorphVertex *vertices)
+{
+    for (int l = 0; l <= maxLevel; ++l)
+    {
+        for (Cube *cube : lods[l]->cubeArray)
+        {
+            for (int i = 0; i < cube->vertCount; ++i)
+            {
+                size_t v = cube->vertexOffset + i;
+                size_t p = cube->parentBase + data.remap[v];
+                if (p >= data.posCount)
+                {
+                    p = v;
+                }
+
+                MorphVertex &vertex = vertices[v];
+                memcpy(vertex.position, &data.positions[3 * v], VERTEX_STRIDE);
+                memcpy(vertex.parentPosition, &data.positions[3 * p], VERTEX_STRIDE);
+                vertex.normal = PackNormal(&data.normals[3 * v]);
+                vertex.parentNormal = PackNormal(&data.normals[3 * p]);
+            }
+        }
+    }
+}
+
+size_t HLOD::BuildIndexStream(int maxLevel, vector<unsigned char> &stream)
+{
+    size_t wideCount = 0;
+    stream.clear();
+    stream.reserve(data.idxCount * sizeof(uint16_t));
+
+    for (int l = 0; l <= maxLevel; ++l)
+    {
+        for (Cube *cube : lods[l]->cubeArray)
+        {
+            /* The indices are local to the cube, the draw adds its base vertex */
+            const uint32_t *indices = &data.indices[cube->idxOffset];
+            size_t idxCount = 3 * (size_t)cube->triangleCount;
+            uint32_t maxIndex = 0;
+            for (size_t i = 0; i < idxCount; ++i)
+            {
+                maxIndex = std::max(maxIndex, indices[i]);
+            }
+            cube->indexSize = maxIndex <= UINT16_MAX ? 2 : 4;
+            wideCount += cube->indexSize == 4;
+
+            /* Offsets aligned to the index size */
+            size_t offset = (stream.size() + cube->indexSize - 1) & ~(size_t)(cube->indexSize - 1);
+            stream.resize(offset + idxCount * cube->indexSize);
+            cube->idxByteOffset = offset;
+
+            if (cube->indexSize == 4)
+            {
+                memcpy(&stream[offset], indices, idxCount * sizeof(uint32_t));
+                continue;
+            }
+            uint16_t *shortIndices = (uint16_t *)&stream[offset];
+            for (size_t i = 0; i < idxCount; ++i)
+            {
+                shortIndices[i] = (uint16_t)indices[i];
+            }
+        }
+    }
+    return wideCount;
+}
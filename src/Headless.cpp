@@ -0,0 +1,201 @@
+#include <fstream>
+#include <iostream>
+#include "Headless.h"
+#include "math/transform.h"
+
+#ifdef SC_HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLContext eglContext = EGL_NO_CONTEXT;
+#endif
+
+bool CameraPath::Load(const string &file)
+{
+    ifstream in(file);
+    if (!in.is_open())
+    {
+        cout << "cannot open the camera path " << file << endl;
+        return false;
+    }
+
+    string line;
+    while (getline(in, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        Vec3 p;
+        Quat q;
+        if (sscanf(line.c_str(), "%f %f %f %f %f %f %f", &p.x, &p.y, &p.z, &q.x, &q.y, &q.z, &q.w) != 7)
+        {
+            cout << "skip the camera path line: " << line << endl;
+            continue;
+        }
+        positions.push_back(p);
+        rotations.push_back(q.normalise());
+    }
+    return !positions.empty();
+}
+
+bool CameraPath::Save(const string &file)
+{
+    ofstream out(file);
+    if (!out.is_open())
+    {
+        return false;
+    }
+
+    out << "# px py pz qx qy qz qw" << endl;
+    for (size_t i = 0; i < positions.size(); ++i)
+    {
+        out << positions[i].x << " " << positions[i].y << " " << positions[i].z << " "
+            << rotations[i].x << " " << rotations[i].y << " " << rotations[i].z << " " << rotations[i].w << endl;
+    }
+    return true;
+}
+
+void CameraPath::Append(const Camera &camera)
+{
+    positions.push_back(camera.get_position());
+    rotations.push_back(camera.get_rotation());
+}
+
+void CameraPath::Turntable(const Camera &camera, const Vec3 &target, int frameCount)
+{
+    Camera orbiter = camera;
+    float step = 2.0f * M_PI / frameCount;
+    Quat rot = Quat(Vec3(0.0f, sinf(0.5f * step), 0.0f), cosf(0.5f * step));
+    for (int i = 0; i < frameCount; ++i)
+    {
+        Append(orbiter);
+        orbiter.orbit(rot, target);
+    }
+}
+
+void CameraPath::Apply(size_t frame, Camera &camera)
+{
+    camera.set_position(positions[frame]);
+    camera.set_rotation(rotations[frame]);
+}
+
+bool InitHeadlessContext()
+{
+#ifdef SC_HEADLESS_EGL
+    /* Surfaceless platform first, the default display needs a window system on most drivers */
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+    {
+        eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (eglDisplay == EGL_NO_DISPLAY)
+    {
+        eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint major, minor;
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor))
+    {
+        cout << "Failed to initialize EGL" << endl;
+        return false;
+    }
+
+    /* The default surface type is window, not offered by the surfaceless platform */
+    const EGLint configAttribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(eglDisplay, configAttribs, &config, 1, &configCount) || !configCount)
+    {
+        cout << "No EGL config for desktop OpenGL" << endl;
+        return false;
+    }
+
+    /* 4.5 like the window: storage buffers, immutable buffer storage for the streamed upload */
+    const EGLint contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION, 4,
+                                     EGL_CONTEXT_MINOR_VERSION, 5,
+                                     EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                     EGL_NONE};
+    eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+    if (eglContext == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext))
+    {
+        cout << "Failed to create a surfaceless OpenGL 4.5 context" << endl;
+        return false;
+    }
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+    {
+        cout << "Fialed to initialize GLAD" << endl;
+        return false;
+    }
+
+    cout << "EGL " << major << "." << minor << " " << glGetString(GL_RENDERER) << endl;
+    return true;
+#else
+    cout << "Headless mode needs EGL, build with: make HEADLESS=1" << endl;
+    return false;
+#endif
+}
+
+void DestroyHeadlessContext()
+{
+#ifdef SC_HEADLESS_EGL
+    if (eglDisplay != EGL_NO_DISPLAY)
+    {
+        eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (eglContext != EGL_NO_CONTEXT)
+        {
+            eglDestroyContext(eglDisplay, eglContext);
+        }
+        eglTerminate(eglDisplay);
+    }
+    eglDisplay = EGL_NO_DISPLAY;
+    eglContext = EGL_NO_CONTEXT;
+#endif
+}
+
+bool OffscreenTarget::Init(int w, int h)
+{
+    width = w;
+    height = h;
+
+    glGenTextures(1, &color);
+    glBindTexture(GL_TEXTURE_2D, color);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    bool isComplete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (!isComplete)
+    {
+        cout << "Offscreen framebuffer incomplete" << endl;
+    }
+    return isComplete;
+}
+
+void OffscreenTarget::Bind()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+}
+
+void OffscreenTarget::Destroy()
+{
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &depth);
+    glDeleteTextures(1, &color);
+}
@@ -35,7 +35,9 @@ void ImguiLayer::ImguiDraw(size_t &tri_num)
     ImGui::Checkbox("", &isMultiReso);
 
     ImGui::Checkbox("LOD Adaptive ", &isAdaptiveLOD);
-    ImGui::DragFloat("kappa", &kappa, 0.1, 1, 20, "%.1f");
+    ImGui::DragFloat("pixel error", &pixelError, 0.1, 0.1, 20, "%.1f");
+    ImGui::Checkbox("Triangle Budget", &isTriangleBudget);
+    ImGui::DragInt("budget", &triangleBudget, 10000, 10000, 100000000);
 
     ImGui::Text("\n");
     ImGui::Text("Display Option");
@@ -54,6 +56,8 @@ void ImguiLayer::ImguiDraw(size_t &tri_num)
     ImGui::Text("Control");
     ImGui::Checkbox("VSync", &VSync);
     ImGui::Checkbox("Frustum Culling", &isFrustumCulling);
+    ImGui::Checkbox("Occlusion Culling", &isOcclusionCulling);
+    ImGui::Checkbox("Pipelined Selection", &isPipelined);
     ImGui::Checkbox("Smooth Shading", &isSoomthShading);
 
     ImGui::Text("\n");
@@ -63,6 +67,15 @@ void ImguiLayer::ImguiDraw(size_t &tri_num)
     ImGui::Text("Number of Triangles: %ld /frame (%.4f M / frame)", tri_num, float(tri_num) / 1000000.0);
 
     ImGui::Text("rendered cells: %d", renderCubeCount);
+    ImGui::Text("selection %.2f ms, render CPU %.2f ms, latency %d frames (%.1f ms)", selectionTime, renderCpuTime, latencyFrames, latencyTime);
+    if (isOcclusionCulling)
+    {
+        ImGui::Text("occluded cells: %ld (%.2f ms, %ld occluder faces)", occludedCubeCount, occlusionTime, occluderTriCount);
+    }
+    if (isTriangleBudget)
+    {
+        ImGui::Text("budget: %d selected: %ld (kappa scale %.2f)", triangleBudget, tri_num, budgetScale);
+    }
 
     ImGui::Text("\n");
     ImGui::Text("Original Model Information:");
@@ -73,51 +86,62 @@ void ImguiLayer::ImguiDraw(size_t &tri_num)
     ImGui::Text("Multi-Resolution Model Information:");
     ImGui::Text("vertices: %ld (%.4f M) ", hlodVertexCount, float(hlodVertexCount) / 1000000.0f);
     ImGui::Text("faces: %ld (%.4f M)", hlodTriCount, float(hlodTriCount) / 1000000.0f);
-
-    if (ImGui::Button("Screen Shoot"))
+    if (buildLevelCount)
     {
-        isSavePic = true;
+        char buildText[64];
+        snprintf(buildText, sizeof(buildText), "Building the hierarchy: %d/%d levels", builtLevels, buildLevelCount);
+        ImGui::ProgressBar((float)builtLevels / buildLevelCount, ImVec2(-1.0f, 0.0f), buildText);
     }
-
-    /* Draw the real-time frametime plot */
-    static bool animate = true;
-    ImGui::Checkbox("Animate", &animate);
-    static float values[90] = {0.0f};
-    static int values_offset = 0;
-    static float refresh_time = 0.0;
-
-    if (!animate || refresh_time == 0.0)
+    if (uploadProgress < 1.0f)
     {
-        refresh_time = ImGui::GetTime();
+        ImGui::ProgressBar(uploadProgress, ImVec2(-1.0f, 0.0f), "Uploading to the GPU");
     }
 
-    float value_sum = 0.0;
-    while (refresh_time < ImGui::GetTime())
+    if (ImGui::Button("Screen Shoot"))
     {
-        static float phase = 0.0f;
-        values[values_offset] = 1000.0f / io->Framerate;
-        values_offset = (values_offset + 1) % IM_ARRAYSIZE(values);
-        phase += 0.10f * values_offset;
-        refresh_time += 1.0f * 0.0166667f;
+        isSavePic = true;
     }
-
-    for (int i = 0; i < values_offset; ++i)
+    ImGui::SameLine();
+    ImGui::Checkbox("Record Frames", &isRecordFrames);
+    if (isRecordFrames)
     {
-        value_sum += values[values_offset];
+        ImGui::Text("captured: %ld frames, dropped: %ld, stalls: %ld", capturedCount, captureDroppedCount, captureStallCount);
     }
 
-    string plot_str = std::to_string(value_sum / values_offset);
-    ImGui::PlotLines("Frame Times", values, IM_ARRAYSIZE(values), values_offset, plot_str.c_str(), 0.0f, 36.00f, ImVec2(0, 40));
-
-    /* Write the viewer index into data */
-    ImGui::Checkbox("Export Data", &isRecordData);
-    if (isRecordData)
+    /* Percentiles of every pass over the history, the plotted metric over time and by percentile */
+    if (frameStats && ImGui::CollapsingHeader("Frame Breakdown", ImGuiTreeNodeFlags_DefaultOpen))
     {
-        out.open("data_val.txt", ios::out | ios::app);
-        out << 1000.0f / io->Framerate << " " << tri_num << endl;
-        out.close();
+        ImGui::Text("%-12s %8s %8s %8s  (ms, %d frames)", "", "p50", "p95", "p99", frameStats->count);
+        for (int m = 0; m < SC_METRIC_COUNT; ++m)
+        {
+            FrameMetric metric = (FrameMetric)m;
+            ImGui::Text("%-12s %8.3f %8.3f %8.3f", frameMetricNames[m], frameStats->Percentile(metric, 0.5f),
+                        frameStats->Percentile(metric, 0.95f), frameStats->Percentile(metric, 0.99f));
+        }
+        ImGui::Text("GL calls: %u draws, %u uniforms, %u binds (%u dropped), %u programs", glCalls.draws, glCalls.uniforms,
+                    glCalls.binds, glCalls.droppedBinds, glCalls.programs);
+        if (gpuSkippedCount)
+        {
+            ImGui::Text("GPU timers: %ld frames not timed", gpuSkippedCount);
+        }
+
+        ImGui::Combo("metric", &plotMetric, frameMetricNames, SC_METRIC_COUNT);
+        FrameMetric metric = (FrameMetric)plotMetric;
+        float sorted[SC_FRAME_HISTORY];
+        int count = frameStats->Sorted(metric, sorted);
+        float scaleMax = count ? 1.25f * sorted[count - 1] + 0.001f : 1.0f;
+        char overlay[64];
+        snprintf(overlay, sizeof(overlay), "p50 %.2f  p95 %.2f  p99 %.2f", frameStats->Percentile(metric, 0.5f),
+                 frameStats->Percentile(metric, 0.95f), frameStats->Percentile(metric, 0.99f));
+        ImGui::PlotLines("over time", frameStats->history[metric], SC_FRAME_HISTORY, frameStats->offset, overlay, 0.0f, scaleMax, ImVec2(0, 50));
+        ImGui::PlotLines("percentiles", sorted, count, 0, NULL, 0.0f, scaleMax, ImVec2(0, 50));
     }
 
+    /* Per frame telemetry, written by a background thread */
+    ImGui::Checkbox("Export Data", &isRecordData);
+    ImGui::SameLine();
+    ImGui::Combo("##format", &telemetryFormat, "CSV\0JSON\0");
+
     ImGui::Text("GPU VENDOR: %s", gpuVendorStr);
     ImGui::Text("GPU MODEL: %s", gpuModelStr);
 
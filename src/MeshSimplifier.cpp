@@ -1,5 +1,7 @@
 #include "MeshSimplifier.h"
 #include "mesh_simplify/meshoptimizer_mod.h"
+#include "CpuDispatch.h"
+#include "Trace.h"
 
 /* Threads number */
 const unsigned short threadNum = 8;
@@ -10,11 +12,12 @@ size_t RemapIndexBufferSkipDegenerate(uint32_t *indices, size_t index_count, con
 {
     size_t newIdxCount = 0;
 
+    cpuKernels.remapIndices(indices, index_count, remap);
     for (size_t i = 0; i < index_count; i += 3)
     {
-        uint32_t i0 = remap[indices[i + 0]];
-        uint32_t i1 = remap[indices[i + 1]];
-        uint32_t i2 = remap[indices[i + 2]];
+        uint32_t i0 = indices[i + 0];
+        uint32_t i1 = indices[i + 1];
+        uint32_t i2 = indices[i + 2];
 
         if (i0 != i1 && i0 != i2 && i1 != i2)
         {
@@ -28,6 +31,249 @@ size_t RemapIndexBufferSkipDegenerate(uint32_t *indices, size_t index_count, con
     return newIdxCount;
 }
 
+/* Plane quadric of the clustering simplifier, sum of w (n.p + d)^2 */
+struct ClusterQuadric
+{
+    float a00 = 0, a11 = 0, a22 = 0, a10 = 0, a20 = 0, a21 = 0;
+    float b0 = 0, b1 = 0, b2 = 0, c = 0, w = 0;
+
+    ClusterQuadric() {}
+    ClusterQuadric(const Vec3 &n, float d, float w)
+        : a00(w * n.x * n.x), a11(w * n.y * n.y), a22(w * n.z * n.z), a10(w * n.y * n.x), a20(w * n.z * n.x), a21(w * n.z * n.y),
+          b0(w * n.x * d), b1(w * n.y * d), b2(w * n.z * d), c(w * d * d), w(w) {}
+
+    void Add(const ClusterQuadric &q)
+    {
+        a00 += q.a00, a11 += q.a11, a22 += q.a22, a10 += q.a10, a20 += q.a20, a21 += q.a21;
+        b0 += q.b0, b1 += q.b1, b2 += q.b2, c += q.c, w += q.w;
+    }
+
+    float Error(const Vec3 &p) const
+    {
+        float rx = p.x * a00 + p.y * a10 + p.z * a20;
+        float ry = p.x * a10 + p.y * a11 + p.z * a21;
+        float rz = p.x * a20 + p.y * a21 + p.z * a22;
+        float r = p.x * rx + p.y * ry + p.z * rz + 2.0f * (p.x * b0 + p.y * b1 + p.z * b2) + c;
+        return w > 0.0f ? fabsf(r) / w : 0.0f;
+    }
+};
+
+/* Triangles left with three distinct cells on a grid of the given resolution, x + grid * (y + grid * z) */
+static size_t CountClusterTriangles(const uint32_t *indices, size_t idxCount, const float *normalized, size_t vertexCount,
+                                    const unsigned char *isKept, int grid, uint32_t *cells)
+{
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        /* A kept vertex is a cell of its own, above the grid cells */
+        if (isKept[i])
+        {
+            cells[i] = 0x80000000u | (uint32_t)i;
+            continue;
+        }
+        uint32_t c[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            c[k] = (uint32_t)min(max((int)(normalized[3 * i + k] * grid), 0), grid - 1);
+        }
+        cells[i] = c[0] + grid * (c[1] + grid * c[2]);
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < idxCount; i += 3)
+    {
+        uint32_t c0 = cells[indices[i]], c1 = cells[indices[i + 1]], c2 = cells[indices[i + 2]];
+        count += c0 != c1 && c0 != c2 && c1 != c2;
+    }
+    return 3 * count;
+}
+
+size_t ClusterSimplify(uint32_t *destination, uint32_t *simplificationRemap, const uint32_t *indices, size_t idxCount,
+                       const float *positions, size_t vertexCount, size_t targetIdxCount, float *resultError,
+                       float extent, float offset[3], const unsigned char *vertexLock)
+{
+    /* Positions in the block box, the margin is where the quadric simplifier keeps the open border */
+    vector<float> normalized(3 * vertexCount);
+    vector<unsigned char> isMargin(vertexCount);
+    float scale = extent > 0.0f ? 1.0f / extent : 0.0f;
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        float *p = &normalized[3 * i];
+        for (int k = 0; k < 3; ++k)
+        {
+            p[k] = (positions[3 * i + k] - offset[k]) * scale;
+        }
+        isMargin[i] = !(p[0] > 0.1f && p[0] < 0.9f && p[1] > 0.1f && p[1] < 0.9f && p[2] > 0.1f && p[2] < 0.9f);
+    }
+
+    /* Outgoing edges of each vertex, the mesh is welded */
+    vector<uint32_t> edgeOffsets(vertexCount + 1, 0);
+    vector<uint32_t> edgeTargets(idxCount);
+    for (size_t i = 0; i < idxCount; ++i)
+    {
+        edgeOffsets[indices[i] + 1]++;
+    }
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        edgeOffsets[i + 1] += edgeOffsets[i];
+    }
+    vector<uint32_t> cursor(edgeOffsets.begin(), edgeOffsets.end() - 1);
+    for (size_t i = 0; i < idxCount; i += 3)
+    {
+        for (int e = 0; e < 3; ++e)
+        {
+            edgeTargets[cursor[indices[i + e]]++] = indices[i + (e + 1) % 3];
+        }
+    }
+
+    /* Open border in the margin: an edge without its reverse, shared with the next block it keeps its vertices
+     * so that both sides still meet */
+    vector<unsigned char> isKept(vertexCount, 0);
+    for (size_t v0 = 0; v0 < vertexCount; ++v0)
+    {
+        for (uint32_t e = edgeOffsets[v0]; isMargin[v0] && e < edgeOffsets[v0 + 1]; ++e)
+        {
+            uint32_t v1 = edgeTargets[e];
+            if (!isMargin[v1])
+            {
+                continue;
+            }
+            uint32_t *begin = &edgeTargets[edgeOffsets[v1]], *end = &edgeTargets[0] + edgeOffsets[v1 + 1];
+            if (find(begin, end, (uint32_t)v0) == end)
+            {
+                isKept[v0] = isKept[v1] = 1;
+            }
+        }
+    }
+    for (size_t i = 0; vertexLock && i < vertexCount; ++i)
+    {
+        isKept[i] |= vertexLock[i];
+    }
+
+    /* Finest grid within the target. The count of a surface grows with the square of the resolution, the next
+     * resolution is interpolated from it and the search stops after a few passes */
+    vector<uint32_t> cells(vertexCount);
+    int minGrid = 1, maxGrid = SC_CLUSTER_MAX_GRID;
+    int grid = min(max((int)sqrtf(targetIdxCount / 6.0f), 1), maxGrid);
+    int evaluated = 0;
+    for (int pass = 0; pass < SC_CLUSTER_PASSES && minGrid < maxGrid; ++pass)
+    {
+        size_t count = CountClusterTriangles(indices, idxCount, normalized.data(), vertexCount, isKept.data(), grid, cells.data());
+        evaluated = grid;
+        if (count <= targetIdxCount)
+        {
+            minGrid = grid;
+        }
+        else
+        {
+            maxGrid = grid - 1;
+        }
+
+        int next = (int)(grid * sqrtf((float)targetIdxCount / max(count, (size_t)1)));
+        next = next == grid ? (count <= targetIdxCount ? grid + 1 : grid - 1) : next;
+        grid = min(max(next, minGrid), maxGrid);
+    }
+    if (evaluated != minGrid)
+    {
+        CountClusterTriangles(indices, idxCount, normalized.data(), vertexCount, isKept.data(), minGrid, cells.data());
+    }
+
+    /* Cell index of the vertices, open addressing on the cell key */
+    size_t tableSize = 1;
+    while (tableSize < 2 * vertexCount)
+    {
+        tableSize <<= 1;
+    }
+    vector<uint32_t> tableKeys(tableSize, ~0u);
+    vector<uint32_t> tableCells(tableSize);
+    vector<uint32_t> cellOf(vertexCount);
+    size_t cellCount = 0;
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        size_t slot = (cells[i] * 2654435761u) & (tableSize - 1);
+        while (tableKeys[slot] != ~0u && tableKeys[slot] != cells[i])
+        {
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        if (tableKeys[slot] == ~0u)
+        {
+            tableKeys[slot] = cells[i];
+            tableCells[slot] = cellCount++;
+        }
+        cellOf[i] = tableCells[slot];
+    }
+
+    /* Plane quadrics of the vertices in the block box, weighted like the quadric simplifier so that both report
+     * errors on the same scale */
+    vector<ClusterQuadric> vertexQuadrics(vertexCount);
+    for (size_t i = 0; i < idxCount; i += 3)
+    {
+        Vec3 p0(&normalized[3 * indices[i]]), p1(&normalized[3 * indices[i + 1]]), p2(&normalized[3 * indices[i + 2]]);
+        Vec3 normal = cross(p1 - p0, p2 - p0);
+        float area = norm(normal);
+        if (area <= 0.0f)
+        {
+            continue;
+        }
+        normal = (1.0f / area) * normal;
+        ClusterQuadric q(normal, -dot(normal, p0), sqrtf(area));
+        for (int e = 0; e < 3; ++e)
+        {
+            vertexQuadrics[indices[i + e]].Add(q);
+        }
+    }
+
+    vector<ClusterQuadric> cellQuadrics(cellCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        cellQuadrics[cellOf[i]].Add(vertexQuadrics[i]);
+    }
+
+    /* The representative is the vertex of the cell closest to the planes of the cell, as the sloppy simplifier of
+     * meshoptimizer does: the parents stay on the input surface and keep its features */
+    vector<uint32_t> representative(cellCount);
+    vector<float> bestError(cellCount, FLT_MAX);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        uint32_t c = cellOf[i];
+        float error = cellQuadrics[c].Error(Vec3(&normalized[3 * i]));
+        if (error < bestError[c])
+        {
+            bestError[c] = error;
+            representative[c] = i;
+        }
+    }
+
+    /* Error of a vertex: its quadric at the representative, a move along the surface costs nothing */
+    float maxError = 0.0f;
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        uint32_t r = representative[cellOf[i]];
+        simplificationRemap[i] = r;
+        maxError = max(maxError, vertexQuadrics[i].Error(Vec3(&normalized[3 * r])));
+    }
+
+    /* The destination may be the input, the triangles only move down */
+    size_t resultCount = 0;
+    for (size_t i = 0; i < idxCount; i += 3)
+    {
+        uint32_t i0 = simplificationRemap[indices[i]];
+        uint32_t i1 = simplificationRemap[indices[i + 1]];
+        uint32_t i2 = simplificationRemap[indices[i + 2]];
+        if (i0 != i1 && i0 != i2 && i1 != i2)
+        {
+            destination[resultCount++] = i0;
+            destination[resultCount++] = i1;
+            destination[resultCount++] = i2;
+        }
+    }
+
+    if (resultError)
+    {
+        *resultError = sqrtf(max(maxError, 0.0f)) * extent;
+    }
+    return resultCount;
+}
+
 unsigned LoadBlockData(HLOD *hlod, Boxcoord& blkCoord, int curLevel, int width, unordered_map<uint64_t, pair<size_t, size_t>>& cubeTable, Mesh *destination, bool isGetData){
     Boxcoord temp;
     size_t indexOffset = 0;
@@ -45,30 +291,27 @@ unsigned LoadBlockData(HLOD *hlod, Boxcoord& blkCoord, int curLevel, int width,
                 temp.z = nz + dz;
 
                 Boxcoord result;
-                if(!ConvertBlockCoordinates(temp, result, SC_BLOCK_SIZE, hlod->lods[curLevel]->lodSize)){
+                if(!ConvertBlockCoordinates(temp, result, width, hlod->lods[curLevel]->lodSize)){
                     continue;
                 }
                 
                 uint64_t coord = (uint64_t)(result.x) | ((uint64_t)(result.y) << 16) | ((uint64_t)(result.z) << 32);
                 
-                if (hlod->lods[curLevel]->cubeTable.count(coord) == 0){
+                auto cube = hlod->lods[curLevel]->cubeTable.find(coord);
+                if (cube == hlod->lods[curLevel]->cubeTable.end()){
                     continue;
                 }
                     
-                int indexCount = hlod->lods[curLevel]->cubeTable[coord].triangleCount * 3;
-                int vertexCount = hlod->lods[curLevel]->cubeTable[coord].vertCount;
+                int indexCount = cube->second.triangleCount * 3;
+                int vertexCount = cube->second.vertCount;
 
                 if (isGetData){
                     /* Offset of hlod data buffer */
-                    size_t cubeVertexOffset = hlod->lods[curLevel]->cubeTable[coord].vertexOffset;
-                    size_t cubeIdxOffset = hlod->lods[curLevel]->cubeTable[coord].idxOffset;
+                    size_t cubeVertexOffset = cube->second.vertexOffset;
+                    size_t cubeIdxOffset = cube->second.idxOffset;
 
                     uint32_t *targetIndices = destination->indices + indexOffset;
-                    memcpy(targetIndices, &hlod->data.indices[cubeIdxOffset], indexCount * sizeof(uint32_t));
-                    
-                    for (size_t i = 0; i < indexCount; ++i){
-                        targetIndices[i] = targetIndices[i] + vertexOffset;
-                    }
+                    cpuKernels.offsetIndices(targetIndices, &hlod->data.indices[cubeIdxOffset], indexCount, vertexOffset);
                                         
                     /* Position */
                     float *targetPosition = destination->positions + vertexOffset * 3;
@@ -135,11 +378,7 @@ unsigned LoadChildData(HLOD *hlod, Mesh *blkData, uint64_t *cubeList, Boxcoord&
                 size_t cubeIdxOffset = hlod->lods[curLevel]->cubeTable[coord].idxOffset;
 
                 uint32_t *targetIndices = destination->indices + indexOffset;
-                memcpy(targetIndices, &hlod->data.indices[cubeIdxOffset], indexCount * sizeof(uint32_t));
-
-                for (size_t i = 0; i < indexCount; ++i){
-                    targetIndices[i] = targetIndices[i] + vertexOffset;
-                }
+                cpuKernels.offsetIndices(targetIndices, &hlod->data.indices[cubeIdxOffset], indexCount, vertexOffset);
                 
                 /* Position */
                 float *targetPosition = destination->positions + vertexOffset * 3;
@@ -163,55 +402,187 @@ unsigned LoadChildData(HLOD *hlod, Mesh *blkData, uint64_t *cubeList, Boxcoord&
     return cubeCount;
 }
 
-unsigned ComputeMaxCounts(HLOD *hlod, int curLevel, Block* blk){
+/* Store the blocks in the list, the largest first: a large block left to the end of a level keeps one thread
+ * busy while the others idle. The index count stands for the cost, grid order among equals */
+static unsigned StoreBlocks(Block *blk, vector<pair<Boxcoord, BlockCounts>> &blocks){
+    sort(blocks.begin(), blocks.end(), [](const pair<Boxcoord, BlockCounts> &a, const pair<Boxcoord, BlockCounts> &b){
+        if (a.second.idxCount != b.second.idxCount){
+            return a.second.idxCount > b.second.idxCount;
+        }
+        return a.first.x != b.first.x ? a.first.x < b.first.x : (a.first.y != b.first.y ? a.first.y < b.first.y : a.first.z < b.first.z);
+    });
+
     size_t maxIdxCount = 0;
     size_t maxVertexCount = 0;
+    unsigned maxBoxCount = 0;
+    for (size_t i = 0; i < blocks.size(); ++i){
+        blk->list[i] = blocks[i].first;
+        blk->counts[i] = blocks[i].second;
 
-    size_t maxIdxUVCount = 0;
-    size_t maxUVCount = 0;
+        maxBoxCount = max(maxBoxCount, blocks[i].second.boxCount);
+        maxIdxCount = max(maxIdxCount, blocks[i].second.idxCount);
+        maxVertexCount = max(maxVertexCount, blocks[i].second.vertexCount);
+    }
 
-    unsigned maxBoxCount = 0;
+    blk->maxIdxCount = maxIdxCount;
+    blk->maxVertexCount = maxVertexCount;
+    blk->validBoxCount = blocks.size();
 
-    unsigned short blockCount = 0;
+    return maxBoxCount;
+}
 
-    unordered_map<uint64_t, pair<size_t, size_t>> cubeTable;
+unsigned ComputeMaxCounts(HLOD *hlod, int curLevel, Block* blk){
+    /* Only the occupied cubes are visited, the scan cost does not depend on the grid volume */
+    unordered_map<uint64_t, BlockCounts> blockTable;
+    for (auto &cb : hlod->lods[curLevel]->cubeTable){
+        int nx = (cb.second.coord[0] + SC_COORD_CONVERT) / blk->width * blk->width;
+        int ny = (cb.second.coord[1] + SC_COORD_CONVERT) / blk->width * blk->width;
+        int nz = (cb.second.coord[2] + SC_COORD_CONVERT) / blk->width * blk->width;
+
+        BlockCounts &counts = blockTable[PackCoord(nx, ny, nz)];
+        counts.boxCount++;
+        counts.idxCount += cb.second.triangleCount * 3;
+        counts.vertexCount += cb.second.vertCount;
+        counts.width = blk->width;
+    }
 
-    for (int nx = 0; nx < hlod->lods[curLevel]->lodSize + blk->width; nx = nx + blk->width){
-        for (int ny = 0; ny < hlod->lods[curLevel]->lodSize + blk->width; ny = ny + blk->width){
-            for (int nz = 0; nz < hlod->lods[curLevel]->lodSize + blk->width; nz = nz + blk->width){
-                Boxcoord blkCoord;
-                blkCoord.x = nx, blkCoord.y = ny, blkCoord.z = nz;
-                size_t index_count = 0;
-                size_t vertex_count = 0;
+    vector<pair<Boxcoord, BlockCounts>> blocks;
+    blocks.reserve(blockTable.size());
+    for (auto &bc : blockTable){
+        Boxcoord blkCoord;
+        blkCoord.x = bc.first & 0xFFFF, blkCoord.y = (bc.first >> 16) & 0xFFFF, blkCoord.z = (bc.first >> 32) & 0xFFFF;
+        blocks.push_back(make_pair(blkCoord, bc.second));
+    }
 
-                size_t index_uv_count = 0;
-                size_t uv_count = 0;
+    return StoreBlocks(blk, blocks);
+}
 
-                /* Get the data of block */
-                Mesh dest;
-                unsigned box_count = LoadBlockData(hlod, blkCoord, curLevel, blk->width, cubeTable, &dest, false);
+/* A split plane is locked like a block border, so it has to stay free at the next and the previous levels. The block
+ * borders and the split planes fall on the planes 2 mod 4 (real coordinates): their halves at the next level are odd,
+ * inside the parent cubes, and their doubles at the previous level are 0 mod 4, never locked there */
+static bool IsSplitPlane(int blkCoord, int half){
+    int plane = blkCoord - SC_COORD_CONVERT + half;
+    return plane % 4 == 2;
+}
 
-                index_count = dest.idxCount;
-                vertex_count = dest.posCount;
+unsigned SplitHotBlocks(HLOD *hlod, int curLevel, Block *blk){
+    size_t totalIdxCount = 0;
+    for (unsigned i = 0; i < blk->validBoxCount; ++i){
+        totalIdxCount += blk->counts[i].idxCount;
+    }
+    size_t limit = SC_BLOCK_SPLIT_SHARE ? totalIdxCount / (threadNum * SC_BLOCK_SPLIT_SHARE) : 0;
 
-                if (box_count == 0){
-                    continue;
+    vector<pair<Boxcoord, BlockCounts>> blocks;
+    vector<pair<Boxcoord, BlockCounts>> hotBlocks;
+    for (unsigned i = 0; i < blk->validBoxCount; ++i){
+        auto &target = limit && blk->counts[i].idxCount > limit ? hotBlocks : blocks;
+        target.push_back(make_pair(blk->list[i], blk->counts[i]));
+    }
+
+    /* The sub-blocks hold whole parent cubes and their borders stay free at the other levels */
+    while (!hotBlocks.empty()){
+        pair<Boxcoord, BlockCounts> hot = hotBlocks.back();
+        hotBlocks.pop_back();
+        int half = hot.second.width / 2;
+        if (!IsSplitPlane(hot.first.x, half) || !IsSplitPlane(hot.first.y, half) || !IsSplitPlane(hot.first.z, half)){
+            blocks.push_back(hot);
+            continue;
+        }
+
+        for (int octant = 0; octant < 8; ++octant){
+            pair<Boxcoord, BlockCounts> sub;
+            sub.first.x = hot.first.x + (octant & 1 ? half : 0);
+            sub.first.y = hot.first.y + (octant & 2 ? half : 0);
+            sub.first.z = hot.first.z + (octant & 4 ? half : 0);
+            sub.second.width = half;
+
+            for (int dx = 0; dx < half; ++dx){
+                for (int dy = 0; dy < half; ++dy){
+                    for (int dz = 0; dz < half; ++dz){
+                        Boxcoord temp, result;
+                        temp.x = sub.first.x + dx, temp.y = sub.first.y + dy, temp.z = sub.first.z + dz;
+                        if (!ConvertBlockCoordinates(temp, result, half, hlod->lods[curLevel]->lodSize)){
+                            continue;
+                        }
+                        auto cube = hlod->lods[curLevel]->cubeTable.find(PackCoord(result.x, result.y, result.z));
+                        if (cube == hlod->lods[curLevel]->cubeTable.end()){
+                            continue;
+                        }
+                        sub.second.boxCount++;
+                        sub.second.idxCount += cube->second.triangleCount * 3;
+                        sub.second.vertexCount += cube->second.vertCount;
+                    }
                 }
-                    
-                blk->list[blockCount] = blkCoord;
-                blockCount++;
+            }
 
-                maxBoxCount = box_count > maxBoxCount ? box_count : maxBoxCount;
-                maxIdxCount = index_count > maxIdxCount ? index_count : maxIdxCount;
-                maxVertexCount = vertex_count > maxVertexCount ? vertex_count : maxVertexCount;
+            if (sub.second.boxCount){
+                auto &target = sub.second.idxCount > limit ? hotBlocks : blocks;
+                target.push_back(sub);
             }
         }
     }
-    blk->maxIdxCount = maxIdxCount;
-    blk->maxVertexCount = maxVertexCount;
-    blk->validBoxCount = blockCount;
 
-    return maxBoxCount;
+    return StoreBlocks(blk, blocks);
+}
+
+unsigned LockLeafBorderVertices(Parameter &arg, Boxcoord &blkCoord, int width, float *positions, size_t vertexCount, unsigned char *vertexLock){
+    /* Block region with one cube margin */
+    int lo[3], hi[3];
+    lo[0] = blkCoord.x - SC_COORD_CONVERT - 1, lo[1] = blkCoord.y - SC_COORD_CONVERT - 1, lo[2] = blkCoord.z - SC_COORD_CONVERT - 1;
+    for (int k = 0; k < 3; ++k){
+        hi[k] = lo[k] + width + 1;
+        lo[k] = lo[k] < 0 ? 0 : lo[k];
+    }
+
+    /* Gather the vertices of the coarser leaf cubes around the block */
+    vector<float> leafPositions;
+    for (int j = arg.curLevel + 1; j < SC_MAX_LOD_LEVEL && arg.hlod->lods[j]; ++j){
+        int shift = j - arg.curLevel;
+        for (int x = lo[0] >> shift; x <= hi[0] >> shift; ++x){
+            for (int y = lo[1] >> shift; y <= hi[1] >> shift; ++y){
+                for (int z = lo[2] >> shift; z <= hi[2] >> shift; ++z){
+                    uint64_t key = PackCoord(x, y, z) | ((uint64_t)(arg.hlod->lods[j]->level) << 48);
+                    auto leaf = arg.coarseLeaves->find(key);
+                    if (leaf == arg.coarseLeaves->end()){
+                        continue;
+                    }
+
+                    float *leafVertices = &arg.hlod->data.positions[3 * leaf->second->vertexOffset];
+                    leafPositions.insert(leafPositions.end(), leafVertices, leafVertices + 3 * leaf->second->vertCount);
+                }
+            }
+        }
+    }
+
+    if (leafPositions.empty()){
+        return 0;
+    }
+
+    /* Block vertices welded with a leaf vertex are shared with the leaf */
+    size_t leafVertexCount = leafPositions.size() / 3;
+    size_t totalCount = vertexCount + leafVertexCount;
+    float *allPositions = (float *)malloc(totalCount * VERTEX_STRIDE);
+    uint32_t *positionRemap = (uint32_t *)malloc(totalCount * sizeof(uint32_t));
+    memcpy(allPositions, positions, vertexCount * VERTEX_STRIDE);
+    memcpy(allPositions + 3 * vertexCount, leafPositions.data(), leafVertexCount * VERTEX_STRIDE);
+
+    size_t uniqueCount = meshopt_generateVertexRemap(positionRemap, NULL, totalCount, allPositions, totalCount, VERTEX_STRIDE);
+    unsigned char *isLeafVertex = (unsigned char *)calloc(uniqueCount, 1);
+    for (size_t i = vertexCount; i < totalCount; ++i){
+        isLeafVertex[positionRemap[i]] = 1;
+    }
+
+    unsigned lockCount = 0;
+    for (size_t i = 0; i < vertexCount; ++i){
+        vertexLock[i] = isLeafVertex[positionRemap[i]];
+        lockCount += vertexLock[i];
+    }
+
+    MemoryFree(allPositions);
+    MemoryFree(positionRemap);
+    MemoryFree(isLeafVertex);
+
+    return lockCount;
 }
 
 void UpdateVertexParents(void *parents, void *unique_parents, size_t vertex_count, size_t uniqueVertexCount,
@@ -234,17 +605,19 @@ void InitParentMeshGrid(LOD *pmg, LOD *mg){
 void *BlockSimplification(Parameter &arg, unsigned int block_idx)
 {
     Boxcoord blkCoord = arg.simplifyBlks->list[block_idx];
+    BlockCounts &blkCounts = arg.simplifyBlks->counts[block_idx];
+    int width = blkCounts.width;
 
     unordered_map<uint64_t, pair<size_t, size_t>> cubeTable;
-    /* Mesh data buffer */
+    /* Mesh data buffer, sized for this block */
     Mesh simplifyBlk;
-    simplifyBlk.indices = (uint32_t *)malloc(arg.simplifyBlks->maxIdxCount * sizeof(uint32_t));
-    simplifyBlk.positions = (float *)malloc(arg.simplifyBlks->maxVertexCount * VERTEX_STRIDE);
-    simplifyBlk.normals = (float *)malloc(arg.simplifyBlks->maxVertexCount * VERTEX_STRIDE);
+    simplifyBlk.indices = (uint32_t *)malloc(blkCounts.idxCount * sizeof(uint32_t));
+    simplifyBlk.positions = (float *)malloc(blkCounts.vertexCount * VERTEX_STRIDE);
+    simplifyBlk.normals = (float *)malloc(blkCounts.vertexCount * VERTEX_STRIDE);
     simplifyBlk.idxCount = 0;
     simplifyBlk.posCount = 0;
 
-    unsigned box_count = LoadBlockData(arg.hlod, blkCoord, arg.curLevel, SC_BLOCK_SIZE, cubeTable, &simplifyBlk, true);
+    unsigned box_count = LoadBlockData(arg.hlod, blkCoord, arg.curLevel, width, cubeTable, &simplifyBlk, true);
 
     if (!box_count)
     {
@@ -253,12 +626,12 @@ void *BlockSimplification(Parameter &arg, unsigned int block_idx)
 
     float extension = arg.hlod->lods[arg.curLevel]->cubeLength;
     float simplification_error = arg.targetError * extension;
-    float blockExtension = 4 * extension;
+    float blockExtension = width * extension;
 
     Boxcoord realCoord;
-    realCoord.x = (blkCoord.x - arg.simplifyBlks->width / 2);
-    realCoord.y = (blkCoord.y - arg.simplifyBlks->width / 2);
-    realCoord.z = (blkCoord.z - arg.simplifyBlks->width / 2);
+    realCoord.x = (blkCoord.x - SC_COORD_CONVERT);
+    realCoord.y = (blkCoord.y - SC_COORD_CONVERT);
+    realCoord.z = (blkCoord.z - SC_COORD_CONVERT);
 
     float blkBottom[3];
     blkBottom[0] = arg.hlod->min[0] + realCoord.x * extension;
@@ -266,16 +639,39 @@ void *BlockSimplification(Parameter &arg, unsigned int block_idx)
     blkBottom[2] = arg.hlod->min[2] + realCoord.z * extension;
 
     /* Allocate memory for simplified mesh */
-    float *uniquePositions = (float *)malloc(arg.simplifyBlks->maxVertexCount * VERTEX_STRIDE);
-    uint32_t *remap = (uint32_t *)malloc(arg.simplifyBlks->maxVertexCount * sizeof(uint32_t));
-    uint32_t *simplificationRemap = (uint32_t *)malloc(arg.simplifyBlks->maxVertexCount * sizeof(uint32_t));
+    float *uniquePositions = (float *)malloc(blkCounts.vertexCount * VERTEX_STRIDE);
+    uint32_t *remap = (uint32_t *)malloc(blkCounts.vertexCount * sizeof(uint32_t));
+    uint32_t *simplificationRemap = (uint32_t *)malloc(blkCounts.vertexCount * sizeof(uint32_t));
 
     /* Mesh simplification */
     size_t uniqueVertexCount = meshopt_generateVertexRemap(remap, NULL, simplifyBlk.posCount, simplifyBlk.positions, simplifyBlk.posCount, VERTEX_STRIDE);
     meshopt_remapVertexBuffer(uniquePositions, simplifyBlk.positions, simplifyBlk.posCount, VERTEX_STRIDE, remap);
     simplifyBlk.idxCount = RemapIndexBufferSkipDegenerate(simplifyBlk.indices, simplifyBlk.idxCount, remap);
-    size_t resultIndexCount = meshopt_simplify_mod(simplifyBlk.indices, simplificationRemap, simplifyBlk.indices, simplifyBlk.idxCount, uniquePositions,
-                                                   uniqueVertexCount, VERTEX_STRIDE, simplifyBlk.idxCount / 4, simplification_error, NULL, blockExtension, blkBottom);
+
+    /* Adaptive subdivision: the border shared with a coarser leaf cube keeps its full resolution */
+    unsigned char *vertexLock = NULL;
+    if (!arg.coarseLeaves->empty())
+    {
+        vertexLock = (unsigned char *)malloc(uniqueVertexCount);
+        if (!LockLeafBorderVertices(arg, blkCoord, width, uniquePositions, uniqueVertexCount, vertexLock))
+        {
+            MemoryFree(vertexLock);
+            vertexLock = NULL;
+        }
+    }
+
+    float resultError = 0.0f;
+    if (arg.policy == SC_SIMPLIFY_CLUSTER)
+    {
+        ClusterSimplify(simplifyBlk.indices, simplificationRemap, simplifyBlk.indices, simplifyBlk.idxCount, uniquePositions,
+                        uniqueVertexCount, simplifyBlk.idxCount / 4, &resultError, blockExtension, blkBottom, vertexLock);
+    }
+    else
+    {
+        meshopt_simplify_mod(simplifyBlk.indices, simplificationRemap, simplifyBlk.indices, simplifyBlk.idxCount, uniquePositions,
+                             uniqueVertexCount, VERTEX_STRIDE, simplifyBlk.idxCount / 4, simplification_error, &resultError, blockExtension, blkBottom, vertexLock);
+    }
+    MemoryFree(vertexLock);
 
     /* Update and wirte back parent information */
     UpdateVertexParents(simplifyBlk.positions, uniquePositions, simplifyBlk.posCount, uniqueVertexCount, VERTEX_STRIDE, remap, simplificationRemap);
@@ -291,11 +687,11 @@ void *BlockSimplification(Parameter &arg, unsigned int block_idx)
     parentBlk.positions = (float *)malloc(arg.parentBlks->maxVertexCount * VERTEX_STRIDE);
     parentBlk.normals = (float *)malloc(arg.parentBlks->maxVertexCount * VERTEX_STRIDE);
 
-    for (unsigned short ix = blkCoord.x; ix < blkCoord.x + SC_BLOCK_SIZE; ix = ix + 2)
+    for (unsigned short ix = blkCoord.x; ix < blkCoord.x + width; ix = ix + 2)
     {
-        for (unsigned short iy = blkCoord.y; iy < blkCoord.y + SC_BLOCK_SIZE; iy = iy + 2)
+        for (unsigned short iy = blkCoord.y; iy < blkCoord.y + width; iy = iy + 2)
         {
-            for (unsigned short iz = blkCoord.z; iz < blkCoord.z + SC_BLOCK_SIZE; iz = iz + 2)
+            for (unsigned short iz = blkCoord.z; iz < blkCoord.z + width; iz = iz + 2)
             {
                 Boxcoord parentCoord;
                 parentCoord.x = ix, parentCoord.y = iy, parentCoord.z = iz;
@@ -322,7 +718,25 @@ void *BlockSimplification(Parameter &arg, unsigned int block_idx)
 
                 uint64_t ijk_p = (uint64_t)(parentCoord.x) | ((uint64_t)(parentCoord.y) << 16) | ((uint64_t)(parentCoord.z) << 32);
 
+                /* The children bounds hold the positions their vertices morph to, each child belongs to this block only */
+                Cube *childCubes[8];
+                size_t childVertexOffset = 0;
+                for (unsigned i = 0; i < childCubeCount; ++i)
+                {
+                    childCubes[i] = &arg.hlod->lods[arg.curLevel]->cubeTable.find(cubeList[i])->second;
+                    for (int j = 0; j < childCubes[i]->vertCount; ++j)
+                    {
+                        /* Vertices left without triangle have no parent */
+                        if (parentRemap[childVertexOffset + j] != ~0u)
+                        {
+                            childCubes[i]->ExpandBounds(&unqiueParentPosition[3 * parentRemap[childVertexOffset + j]]);
+                        }
+                    }
+                    childVertexOffset += childCubes[i]->vertCount;
+                }
+
                 Cube parentCube;
+                parentCube.ComputeTightBounds(unqiueParentPosition, uniqueParentCount, childCubes, childCubeCount);
 
                 parentCube.coord[0] = parentCoord.x;
                 parentCube.coord[1] = parentCoord.y;
@@ -330,6 +744,20 @@ void *BlockSimplification(Parameter &arg, unsigned int block_idx)
 
                 parentCube.coord64 = ijk_p;
 
+                /* Error of the block simplification on top of the error already in the children */
+                float childError = 0.0f;
+                for (unsigned i = 0; i < childCubeCount; ++i)
+                {
+                    childError = max(childError, childCubes[i]->error);
+                }
+                parentCube.error = childError + resultError;
+
+                /* Existing children, their array index is set once the whole hierarchy is built */
+                for (unsigned i = 0; i < childCubeCount; ++i)
+                {
+                    parentCube.childMask |= 1 << ((childCubes[i]->coord[0] & 1) * 4 + (childCubes[i]->coord[1] & 1) * 2 + (childCubes[i]->coord[2] & 1));
+                }
+
                 pthread_mutex_lock(&block_index_mutex);
                 {
                     parentCube.triangleCount = parentBlk.idxCount / 3;
@@ -340,10 +768,15 @@ void *BlockSimplification(Parameter &arg, unsigned int block_idx)
 
                     arg.hlod->curIdxOffset += parentBlk.idxCount;
                     arg.hlod->curVertOffset += uniqueParentCount;
+
+                    arg.hlod->lods[arg.curLevel + 1]->cubeTable.insert(make_pair(ijk_p, parentCube));
                 }
                 pthread_mutex_unlock(&block_index_mutex);
 
-                arg.hlod->lods[arg.curLevel + 1]->cubeTable.insert(make_pair(ijk_p, parentCube));
+                for (unsigned i = 0; i < childCubeCount; ++i)
+                {
+                    childCubes[i]->parentBase = parentCube.vertexOffset;
+                }
 
                 memcpy(&arg.hlod->data.indices[parentCube.idxOffset], parentBlk.indices, parentBlk.idxCount * sizeof(uint32_t));
                 memcpy(&arg.hlod->data.positions[3 * parentCube.vertexOffset], unqiueParentPosition, uniqueParentCount * VERTEX_STRIDE);
@@ -396,7 +829,7 @@ bool BuileNextBlock(Parameter &param)
     pthread_mutex_lock(&block_index_mutex);
     unsigned curIdx = nextIdx;
 
-    if (curIdx >= param.simplifyBlks->validBoxCount)
+    if (curIdx >= param.simplifyBlks->validBoxCount || (param.isCancelled && param.isCancelled->load(memory_order_relaxed)))
     {
         pthread_mutex_unlock(&block_index_mutex);
         return false;
@@ -404,40 +837,55 @@ bool BuileNextBlock(Parameter &param)
     nextIdx++;
     pthread_mutex_unlock(&block_index_mutex);
 
+    SC_TRACE_ZONE_ARG("BlockSimplification", "block", curIdx);
     BlockSimplification(param, curIdx);
 
     return true;
 }
 
 void *BuildParallel(void *arg){
+    SC_TRACE_THREAD("simplify worker");
     Parameter tmp = *(Parameter *)arg;
 
     while (BuileNextBlock(tmp)){}
     return NULL;
 }
 
-void LODConstructor(HLOD *hlod, int curLevel, int width, float targetError)
+void LODConstructor(HLOD *hlod, int curLevel, int width, float targetError, SimplifyPolicy policy, const std::atomic<bool> *isCancelled)
 {
     /* Init parent mesh level */
     InitParentMeshGrid(hlod->lods[curLevel + 1], hlod->lods[curLevel]);
 
-    int lodSize = hlod->lods[curLevel]->lodSize;
-
-    /* Simplification block information */
-    unsigned short value = int((lodSize + width) / width);
-    unsigned short maxBlkCount = value * value * value;
+    /* Simplification block information, at most one block per occupied cube */
+    size_t maxBlkCount = hlod->lods[curLevel]->cubeTable.size();
 
     Block simplifyBlks;
     simplifyBlks.width = width;
-    simplifyBlks.list = (Boxcoord *)calloc(maxBlkCount, maxBlkCount * 3 * sizeof(unsigned short));
-    simplifyBlks.maxBoxCount = ComputeMaxCounts(hlod, curLevel, &simplifyBlks);
+    simplifyBlks.list = (Boxcoord *)calloc(maxBlkCount, sizeof(Boxcoord));
+    simplifyBlks.counts = (BlockCounts *)calloc(maxBlkCount, sizeof(BlockCounts));
+    ComputeMaxCounts(hlod, curLevel, &simplifyBlks);
+    simplifyBlks.maxBoxCount = SplitHotBlocks(hlod, curLevel, &simplifyBlks);
 
     /* Parent cube construction block information */
     Block parentBlks;
     parentBlks.width = 2;
-    parentBlks.list = (Boxcoord *)calloc(maxBlkCount, maxBlkCount * 3 * sizeof(unsigned short));
+    parentBlks.list = (Boxcoord *)calloc(maxBlkCount, sizeof(Boxcoord));
+    parentBlks.counts = (BlockCounts *)calloc(maxBlkCount, sizeof(BlockCounts));
     parentBlks.maxBoxCount = ComputeMaxCounts(hlod, curLevel, &parentBlks);
 
+    /* Leaf cubes of the coarser levels (adaptive subdivision), their nodes stay valid while parents are inserted */
+    unordered_map<uint64_t, Cube *> coarseLeaves;
+    for (int j = curLevel + 1; j < SC_MAX_LOD_LEVEL && hlod->lods[j]; ++j)
+    {
+        for (auto &cb : hlod->lods[j]->cubeTable)
+        {
+            if (cb.second.isLeaf)
+            {
+                coarseLeaves[cb.first | ((uint64_t)(hlod->lods[j]->level) << 48)] = &cb.second;
+            }
+        }
+    }
+
     /* Thread parameter */
     Parameter attr;
     attr.hlod = hlod;
@@ -445,6 +893,9 @@ void LODConstructor(HLOD *hlod, int curLevel, int width, float targetError)
     attr.simplifyBlks = &simplifyBlks;
     attr.parentBlks = &parentBlks;
     attr.targetError = targetError;
+    attr.policy = policy;
+    attr.coarseLeaves = &coarseLeaves;
+    attr.isCancelled = isCancelled;
     nextIdx = 0;
 
     /* Allocate memory for next LOD level */
@@ -459,6 +910,7 @@ void LODConstructor(HLOD *hlod, int curLevel, int width, float targetError)
     /* Create threads */
     pthread_t threads[threadNum];
     pthread_mutex_init(&block_index_mutex, NULL);
+    SC_TRACE_BEGIN(simplifyZone, "SimplifyBlocks");
 
     for (int i = 0; i < threadNum; ++i)
     {
@@ -470,18 +922,26 @@ void LODConstructor(HLOD *hlod, int curLevel, int width, float targetError)
 
         pthread_join(threads[i], NULL);
     }
+    SC_TRACE_END(simplifyZone);
 
     pthread_mutex_destroy(&block_index_mutex);
 
+    MemoryFree(simplifyBlks.list);
+    MemoryFree(simplifyBlks.counts);
+    MemoryFree(parentBlks.list);
+    MemoryFree(parentBlks.counts);
+
     /* Compute the blkCoord vertex of cube for next LOD */
     for (auto &cb : hlod->lods[curLevel + 1]->cubeTable)
     {
         cb.second.ComputeBottomVertex(cb.second.bottom, cb.second.coord, hlod->lods[curLevel + 1]->cubeLength, hlod->min);
+        hlod->lods[curLevel + 1]->maxError = max(hlod->lods[curLevel + 1]->maxError, cb.second.error);
     }
 
     /* For the coarst level, remap is itself */
     if (hlod->lods[curLevel + 1]->level == 0)
     {
+        hlod->lods[curLevel + 1]->cubeTable[0].parentBase = hlod->lods[curLevel + 1]->cubeTable[0].vertexOffset;
         for (int i = 0; i < hlod->lods[curLevel + 1]->cubeTable[0].vertCount; ++i)
         {
             hlod->data.remap[hlod->lods[curLevel + 1]->cubeTable[0].vertexOffset + i] = i;
@@ -492,25 +952,134 @@ void LODConstructor(HLOD *hlod, int curLevel, int width, float targetError)
     hlod->data.idxCount = hlod->curIdxOffset;
 }
 
-void HLODConsructor(HLOD *hlod, int maxLevel, float targetError)
+bool HLODConsructor(HLOD *hlod, int maxLevel, float targetError, int blockWidth, int clusterDepth, std::atomic<int> *builtLevels,
+                    const std::atomic<bool> *isCancelled)
 {
+    /* The block holds whole parent cubes and its border must not fall on the border of the next level blocks */
+    if (blockWidth < SC_BLOCK_SIZE || blockWidth % 2)
+    {
+        cout << "block width " << blockWidth << " is not an even number of at least " << SC_BLOCK_SIZE << ", use ";
+        blockWidth = blockWidth < SC_BLOCK_SIZE ? SC_BLOCK_SIZE : blockWidth + 1;
+        cout << blockWidth << endl;
+    }
+
     for (int i = 0; i < maxLevel; i++)
     {
-        hlod->lods[i + 1] = new LOD(maxLevel - 1 - i);
-        cout << "LOD: " << maxLevel - 1 - i << " ";
+        if (!hlod->lods[i + 1])
+        {
+            hlod->lods[i + 1] = new LOD(maxLevel - 1 - i);
+        }
+        SimplifyPolicy policy = maxLevel - 1 - i < clusterDepth ? SC_SIMPLIFY_CLUSTER : SC_SIMPLIFY_QUADRIC;
+        cout << "LOD: " << maxLevel - 1 - i << (policy == SC_SIMPLIFY_CLUSTER ? " (clustering) " : " ");
 
         TimerStart();
-        LODConstructor(hlod, i, SC_BLOCK_SIZE, targetError);
+        SC_TRACE_ZONE_ARG("BuildLevel", "level", maxLevel - 1 - i);
+        LODConstructor(hlod, i, blockWidth, targetError, policy, isCancelled);
         TimerStop("build time: ");
+        if (isCancelled && isCancelled->load())
+        {
+            cout << "cancelled" << endl;
+            return false;
+        }
 
         cout << "Cell: " << hlod->lods[i + 1]->cubeTable.size()
              << " faces: " << hlod->lods[i + 1]->CalculateTriangleCounts()
              << " vertices:  " << hlod->lods[i + 1]->CalculateVertexCounts()
-             << " simplify ratio: " << float(hlod->lods[i + 1]->totalTriCount) / float(hlod->lods[i]->totalTriCount) << endl;
+             << " simplify ratio: " << float(hlod->lods[i + 1]->totalTriCount) / float(hlod->lods[i]->totalTriCount)
+             << " max error: " << hlod->lods[i + 1]->maxError << endl;
+        if (builtLevels)
+        {
+            builtLevels->fetch_add(1);
+        }
     }
 
+    hlod->LinkCubes(maxLevel);
+
     hlod->data.normals = (float *)realloc(hlod->data.normals, hlod->data.posCount * VERTEX_STRIDE);
     hlod->data.positions = (float *)realloc(hlod->data.positions, hlod->data.posCount * VERTEX_STRIDE);
     hlod->data.remap = (uint32_t *)realloc(hlod->data.remap, hlod->data.posCount * sizeof(uint32_t));
     hlod->data.indices = (uint32_t *)realloc(hlod->data.indices, hlod->data.idxCount * sizeof(uint32_t));
-}
\ No newline at end of file
+    return true;
+}
+
+void BenchmarkSimplification(HLOD *hlod, int width, float targetError)
+{
+    Block simplifyBlks;
+    simplifyBlks.width = width;
+    simplifyBlks.list = (Boxcoord *)calloc(hlod->lods[0]->cubeTable.size(), sizeof(Boxcoord));
+    simplifyBlks.counts = (BlockCounts *)calloc(hlod->lods[0]->cubeTable.size(), sizeof(BlockCounts));
+    ComputeMaxCounts(hlod, 0, &simplifyBlks);
+
+    Mesh block;
+    block.indices = (uint32_t *)malloc(simplifyBlks.maxIdxCount * sizeof(uint32_t));
+    block.positions = (float *)malloc(simplifyBlks.maxVertexCount * VERTEX_STRIDE);
+    block.normals = (float *)malloc(simplifyBlks.maxVertexCount * VERTEX_STRIDE);
+    float *uniquePositions = (float *)malloc(simplifyBlks.maxVertexCount * VERTEX_STRIDE);
+    uint32_t *remap = (uint32_t *)malloc(simplifyBlks.maxVertexCount * sizeof(uint32_t));
+    vector<uint32_t> indices[2], simplificationRemap[2];
+
+    float extension = hlod->lods[0]->cubeLength;
+    double seconds[2] = {0.0, 0.0};
+    size_t totalIdxCount = 0;
+    unsigned mismatchCount = 0;
+    int isSimd = meshopt_simplifySimd(-1);
+
+    for (unsigned b = 0; b < simplifyBlks.validBoxCount; ++b)
+    {
+        Boxcoord blkCoord = simplifyBlks.list[b];
+        unordered_map<uint64_t, pair<size_t, size_t>> cubeTable;
+        block.idxCount = 0;
+        block.posCount = 0;
+        if (!LoadBlockData(hlod, blkCoord, 0, width, cubeTable, &block, true))
+        {
+            continue;
+        }
+
+        float blkBottom[3];
+        blkBottom[0] = hlod->min[0] + (blkCoord.x - SC_COORD_CONVERT) * extension;
+        blkBottom[1] = hlod->min[1] + (blkCoord.y - SC_COORD_CONVERT) * extension;
+        blkBottom[2] = hlod->min[2] + (blkCoord.z - SC_COORD_CONVERT) * extension;
+
+        size_t uniqueVertexCount = meshopt_generateVertexRemap(remap, NULL, block.posCount, block.positions, block.posCount, VERTEX_STRIDE);
+        meshopt_remapVertexBuffer(uniquePositions, block.positions, block.posCount, VERTEX_STRIDE, remap);
+        block.idxCount = RemapIndexBufferSkipDegenerate(block.indices, block.idxCount, remap);
+        totalIdxCount += block.idxCount;
+
+        /* Same block through the scalar code, then the SIMD one */
+        size_t resultCount[2];
+        float resultError[2];
+        for (int k = 0; k < 2; ++k)
+        {
+            meshopt_simplifySimd(k);
+            indices[k].resize(block.idxCount);
+            simplificationRemap[k].resize(uniqueVertexCount);
+
+            double start = TimerNow();
+            resultCount[k] = meshopt_simplify_mod(indices[k].data(), simplificationRemap[k].data(), block.indices, block.idxCount, uniquePositions,
+                                                  uniqueVertexCount, VERTEX_STRIDE, block.idxCount / 4, targetError * extension, &resultError[k],
+                                                  width * extension, blkBottom, NULL);
+            seconds[k] += TimerNow() - start;
+        }
+
+        if (resultCount[0] != resultCount[1] || memcmp(&resultError[0], &resultError[1], sizeof(float)) ||
+            memcmp(indices[0].data(), indices[1].data(), resultCount[0] * sizeof(uint32_t)) ||
+            simplificationRemap[0] != simplificationRemap[1])
+        {
+            mismatchCount++;
+        }
+    }
+    meshopt_simplifySimd(1);
+
+    cout << "Simplification bench, blocks: " << simplifyBlks.validBoxCount << " width: " << width
+         << " faces: " << totalIdxCount / 3 << " max block faces: " << simplifyBlks.maxIdxCount / 3 << endl;
+    cout << "scalar: " << seconds[0] * 1e3 << " ms simd: " << seconds[1] * 1e3 << " ms" << (isSimd ? "" : " (no AVX2, scalar)")
+         << " speedup: " << seconds[0] / seconds[1] << " mismatched blocks: " << mismatchCount << endl;
+
+    MemoryFree(block.indices);
+    MemoryFree(block.positions);
+    MemoryFree(block.normals);
+    MemoryFree(uniquePositions);
+    MemoryFree(remap);
+    free(simplifyBlks.list);
+    free(simplifyBlks.counts);
+}
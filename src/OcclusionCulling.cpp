@@ -0,0 +1,413 @@
+#include <emmintrin.h>
+#include <cmath>
+#include <algorithm>
+#include "OcclusionCulling.h"
+
+static void *RasterizeParallel(void *arg)
+{
+    RasterBand *band = (RasterBand *)arg;
+    return band->culler->RasterizeLoop(band);
+}
+
+OcclusionCuller::OcclusionCuller()
+{
+    int w = SC_OCC_WIDTH, h = SC_OCC_HEIGHT;
+    while (pyramidLevels < SC_OCC_MAX_PYRAMID)
+    {
+        pyramidWidth[pyramidLevels] = w;
+        pyramidHeight[pyramidLevels] = h;
+        pyramid[pyramidLevels] = (float *)malloc(w * h * sizeof(float));
+        pyramidLevels++;
+
+        if (w == 1 && h == 1)
+        {
+            break;
+        }
+        w = max(1, w >> 1);
+        h = max(1, h >> 1);
+    }
+
+    pthread_mutex_init(&rasterMutex, NULL);
+    pthread_cond_init(&startCond, NULL);
+    pthread_cond_init(&doneCond, NULL);
+    int bandHeight = (SC_OCC_HEIGHT + SC_OCC_THREADS - 1) / SC_OCC_THREADS;
+    for (int i = 0; i < SC_OCC_THREADS; ++i)
+    {
+        bands[i].culler = this;
+        bands[i].y0 = i * bandHeight;
+        bands[i].y1 = min(SC_OCC_HEIGHT, (i + 1) * bandHeight);
+        if (i)
+        {
+            pthread_create(&rasterizers[i], NULL, RasterizeParallel, (void *)&bands[i]);
+        }
+    }
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+    pthread_mutex_lock(&rasterMutex);
+    isRunning = false;
+    pthread_cond_broadcast(&startCond);
+    pthread_mutex_unlock(&rasterMutex);
+    for (int i = 1; i < SC_OCC_THREADS; ++i)
+    {
+        pthread_join(rasterizers[i], NULL);
+    }
+    pthread_cond_destroy(&doneCond);
+    pthread_cond_destroy(&startCond);
+    pthread_mutex_destroy(&rasterMutex);
+
+    for (int i = 0; i < pyramidLevels; ++i)
+    {
+        MemoryFree(pyramid[i]);
+    }
+}
+
+static inline void TransformPoint(const float *m, const float *p, float *clip)
+{
+    for (int r = 0; r < 4; ++r)
+    {
+        clip[r] = m[r] * p[0] + m[4 + r] * p[1] + m[8 + r] * p[2] + m[12 + r];
+    }
+}
+
+/* Screen position and depth of a point in front of the near plane */
+static inline void ProjectPoint(const float *clip, float *screen)
+{
+    screen[0] = (clip[0] / clip[3] * 0.5f + 0.5f) * SC_OCC_WIDTH;
+    screen[1] = (clip[1] / clip[3] * 0.5f + 0.5f) * SC_OCC_HEIGHT;
+    screen[2] = clip[2] / clip[3];
+}
+
+void OcclusionCuller::AddOccluder(HLOD &hlod, Cube &cube, const float *pvm, const float *eye)
+{
+    /* Clip coordinates of the vertices, moved away from the eye by the simplification error */
+    clipVerts.resize(4 * cube.vertCount);
+    screenVerts.resize(3 * cube.vertCount);
+    for (int i = 0; i < cube.vertCount; ++i)
+    {
+        float p[3];
+        const float *v = &hlod.data.positions[3 * (cube.vertexOffset + i)];
+        float dx = v[0] - eye[0], dy = v[1] - eye[1], dz = v[2] - eye[2];
+        float len = sqrtf(dx * dx + dy * dy + dz * dz);
+        float push = len > 0.0f ? cube.error / len : 0.0f;
+        p[0] = v[0] + dx * push, p[1] = v[1] + dy * push, p[2] = v[2] + dz * push;
+
+        float *clip = &clipVerts[4 * i];
+        TransformPoint(pvm, p, clip);
+        if (clip[3] >= nearPlane)
+        {
+            ProjectPoint(clip, &screenVerts[3 * i]);
+        }
+    }
+
+    const uint32_t *indices = &hlod.data.indices[cube.idxOffset];
+    for (int t = 0; t < cube.triangleCount; ++t)
+    {
+        const float *clip[3];
+        int frontCount = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            clip[k] = &clipVerts[4 * indices[3 * t + k]];
+            frontCount += clip[k][3] >= nearPlane;
+        }
+        if (frontCount == 3)
+        {
+            AddTriangle(&screenVerts[3 * indices[3 * t]], &screenVerts[3 * indices[3 * t + 1]], &screenVerts[3 * indices[3 * t + 2]]);
+            continue;
+        }
+        if (!frontCount)
+        {
+            continue;
+        }
+
+        /* Crossing the near plane: the part in front of it, like the GPU draws it, a triangle or a quad */
+        float polygon[4][3];
+        int count = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            const float *p = clip[k], *q = clip[(k + 1) % 3];
+            bool isPFront = p[3] >= nearPlane, isQFront = q[3] >= nearPlane;
+            if (isPFront)
+            {
+                ProjectPoint(p, polygon[count++]);
+            }
+            if (isPFront != isQFront)
+            {
+                float f = (nearPlane - p[3]) / (q[3] - p[3]), cut[4];
+                for (int c = 0; c < 4; ++c)
+                {
+                    cut[c] = p[c] + f * (q[c] - p[c]);
+                }
+                ProjectPoint(cut, polygon[count++]);
+            }
+        }
+        AddTriangle(polygon[0], polygon[1], polygon[2]);
+        if (count == 4)
+        {
+            AddTriangle(polygon[0], polygon[2], polygon[3]);
+        }
+    }
+}
+
+void OcclusionCuller::AddTriangle(const float *a, const float *b, const float *c)
+{
+    /* Both windings are occluders, store the triangle counter clockwise */
+    float area = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+    if (fabsf(area) < 1e-6f)
+    {
+        return;
+    }
+    if (area < 0.0f)
+    {
+        swap(b, c);
+    }
+
+    screenTris.insert(screenTris.end(), a, a + 3);
+    screenTris.insert(screenTris.end(), b, b + 3);
+    screenTris.insert(screenTris.end(), c, c + 3);
+}
+
+void OcclusionCuller::RasterizeBand(int y0, int y1)
+{
+    float *depth = pyramid[0];
+    const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+    for (size_t t = 0; t < screenTris.size(); t += 9)
+    {
+        const float *v = &screenTris[t];
+
+        /* Pixel bounds inside the band */
+        float minX = min(v[0], min(v[3], v[6])), maxX = max(v[0], max(v[3], v[6]));
+        float minY = min(v[1], min(v[4], v[7])), maxY = max(v[1], max(v[4], v[7]));
+        int px0 = max(0, (int)floorf(minX)) & ~3;
+        int px1 = min(SC_OCC_WIDTH - 1, (int)floorf(maxX));
+        int py0 = max(y0, (int)floorf(minY));
+        int py1 = min(y1 - 1, (int)floorf(maxY));
+        if (px0 > px1 || py0 > py1)
+        {
+            continue;
+        }
+
+        /* Edge functions A * x + B * y + C, positive inside, and the depth plane */
+        float A[3], B[3], C[3];
+        for (int e = 0; e < 3; ++e)
+        {
+            const float *p = &v[3 * e];
+            const float *q = &v[3 * ((e + 1) % 3)];
+            A[e] = p[1] - q[1];
+            B[e] = q[0] - p[0];
+            C[e] = p[0] * q[1] - p[1] * q[0];
+        }
+        float area = C[0] + C[1] + C[2];
+        /* The edge function of an edge is the barycentric weight of the opposite vertex */
+        float zdx = (A[0] * v[8] + A[1] * v[2] + A[2] * v[5]) / area;
+        float zdy = (B[0] * v[8] + B[1] * v[2] + B[2] * v[5]) / area;
+        float zc = (C[0] * v[8] + C[1] * v[2] + C[2] * v[5]) / area;
+
+        /* Four pixels per step */
+        __m128 a0 = _mm_set1_ps(A[0]), a1 = _mm_set1_ps(A[1]), a2 = _mm_set1_ps(A[2]), az = _mm_set1_ps(zdx);
+        __m128 step = _mm_set1_ps(4.0f);
+        __m128 zero = _mm_setzero_ps();
+        for (int y = py0; y <= py1; ++y)
+        {
+            float cy = y + 0.5f;
+            __m128 x = _mm_add_ps(_mm_set1_ps((float)px0), offsets);
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, x), _mm_set1_ps(B[0] * cy + C[0]));
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, x), _mm_set1_ps(B[1] * cy + C[1]));
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, x), _mm_set1_ps(B[2] * cy + C[2]));
+            __m128 z = _mm_add_ps(_mm_mul_ps(az, x), _mm_set1_ps(zdy * cy + zc));
+            __m128 de0 = _mm_mul_ps(a0, step), de1 = _mm_mul_ps(a1, step), de2 = _mm_mul_ps(a2, step), dz = _mm_mul_ps(az, step);
+
+            float *row = depth + y * SC_OCC_WIDTH;
+            for (int px = px0; px <= px1; px += 4)
+            {
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                if (_mm_movemask_ps(inside))
+                {
+                    __m128 old = _mm_loadu_ps(row + px);
+                    __m128 nearer = _mm_min_ps(old, z);
+                    _mm_storeu_ps(row + px, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+                }
+
+                e0 = _mm_add_ps(e0, de0);
+                e1 = _mm_add_ps(e1, de1);
+                e2 = _mm_add_ps(e2, de2);
+                z = _mm_add_ps(z, dz);
+            }
+        }
+    }
+}
+
+void *OcclusionCuller::RasterizeLoop(RasterBand *band)
+{
+    unsigned doneFrame = 0;
+    while (true)
+    {
+        pthread_mutex_lock(&rasterMutex);
+        while (doneFrame == rasterFrame && isRunning)
+        {
+            pthread_cond_wait(&startCond, &rasterMutex);
+        }
+        if (!isRunning)
+        {
+            pthread_mutex_unlock(&rasterMutex);
+            break;
+        }
+        doneFrame = rasterFrame;
+        pthread_mutex_unlock(&rasterMutex);
+
+        RasterizeBand(band->y0, band->y1);
+
+        pthread_mutex_lock(&rasterMutex);
+        if (--pendingBands == 0)
+        {
+            pthread_cond_signal(&doneCond);
+        }
+        pthread_mutex_unlock(&rasterMutex);
+    }
+    return NULL;
+}
+
+void OcclusionCuller::BuildPyramid()
+{
+    for (int l = 1; l < pyramidLevels; ++l)
+    {
+        int srcW = pyramidWidth[l - 1], srcH = pyramidHeight[l - 1];
+        for (int y = 0; y < pyramidHeight[l]; ++y)
+        {
+            for (int x = 0; x < pyramidWidth[l]; ++x)
+            {
+                int sx0 = min(2 * x, srcW - 1), sx1 = min(2 * x + 1, srcW - 1);
+                int sy0 = min(2 * y, srcH - 1), sy1 = min(2 * y + 1, srcH - 1);
+                const float *src = pyramid[l - 1];
+                pyramid[l][y * pyramidWidth[l] + x] = max(max(src[sy0 * srcW + sx0], src[sy0 * srcW + sx1]),
+                                                          max(src[sy1 * srcW + sx0], src[sy1 * srcW + sx1]));
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::IsOccluded(Cube &cube, const float *pvm)
+{
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, minZ = FLT_MAX;
+    for (int i = 0; i < 8; ++i)
+    {
+        float p[3], clip[4];
+        p[0] = (i & 1) ? cube.tightMax[0] : cube.tightMin[0];
+        p[1] = (i & 2) ? cube.tightMax[1] : cube.tightMin[1];
+        p[2] = (i & 4) ? cube.tightMax[2] : cube.tightMin[2];
+        TransformPoint(pvm, p, clip);
+
+        /* Crossing the near plane, always visible */
+        if (clip[3] < nearPlane)
+        {
+            return false;
+        }
+        float sx = (clip[0] / clip[3] * 0.5f + 0.5f) * SC_OCC_WIDTH;
+        float sy = (clip[1] / clip[3] * 0.5f + 0.5f) * SC_OCC_HEIGHT;
+        minX = min(minX, sx), maxX = max(maxX, sx);
+        minY = min(minY, sy), maxY = max(maxY, sy);
+        minZ = min(minZ, clip[2] / clip[3]);
+    }
+
+    int x0 = max(0, (int)floorf(minX)), x1 = min(SC_OCC_WIDTH - 1, (int)floorf(maxX));
+    int y0 = max(0, (int)floorf(minY)), y1 = min(SC_OCC_HEIGHT - 1, (int)floorf(maxY));
+    if (x0 > x1 || y0 > y1)
+    {
+        return false;
+    }
+
+    /* Pyramid level where the rectangle covers at most 2x2 texels */
+    int l = 0;
+    while (l < pyramidLevels - 1 && ((x1 >> l) - (x0 >> l) > 1 || (y1 >> l) - (y0 >> l) > 1))
+    {
+        l++;
+    }
+
+    float maxDepth = -FLT_MAX;
+    for (int y = y0 >> l; y <= (y1 >> l); ++y)
+    {
+        for (int x = x0 >> l; x <= (x1 >> l); ++x)
+        {
+            maxDepth = max(maxDepth, pyramid[l][y * pyramidWidth[l] + x]);
+        }
+    }
+
+    return minZ > maxDepth;
+}
+
+size_t OcclusionCuller::Cull(HLOD &hlod, int maxLevel, RenderList &list, const float *pvm, const float *eye, float nearClip)
+{
+    nearPlane = nearClip;
+
+    /* Occluders: coarser ancestors of the nearest cubes, until the triangle budget */
+    screenTris.clear();
+    occluderTriCount = 0;
+    occluderStamp++;
+    for (size_t i = 0; i < list.records.size() && occluderTriCount < SC_OCC_TRI_BUDGET; ++i)
+    {
+        int lodIdx = list.records[i].lodIdx;
+        int up = min(SC_OCC_LEVEL_UP, maxLevel - lodIdx);
+        Cube *occluder = list.records[i].cube;
+
+        /* Walk up the parent indices, a root cube is its own occluder and appears once in the list */
+        if (up > 0)
+        {
+            int idx = occluder->parentIdx;
+            for (int l = lodIdx + 1; l < lodIdx + up; ++l)
+            {
+                idx = hlod.lods[l]->cubeArray[idx]->parentIdx;
+            }
+
+            vector<unsigned> &stamps = occluderStamps[lodIdx + up];
+            stamps.resize(hlod.lods[lodIdx + up]->cubeArray.size(), 0);
+            if (stamps[idx] == occluderStamp)
+            {
+                continue;
+            }
+            stamps[idx] = occluderStamp;
+            occluder = hlod.lods[lodIdx + up]->cubeArray[idx];
+        }
+
+        AddOccluder(hlod, *occluder, pvm, eye);
+        occluderTriCount += occluder->triangleCount;
+    }
+
+    /* Depth buffer, one band per thread */
+    fill(pyramid[0], pyramid[0] + SC_OCC_WIDTH * SC_OCC_HEIGHT, FLT_MAX);
+
+    pthread_mutex_lock(&rasterMutex);
+    rasterFrame++;
+    pendingBands = SC_OCC_THREADS - 1;
+    pthread_cond_broadcast(&startCond);
+    pthread_mutex_unlock(&rasterMutex);
+
+    RasterizeBand(bands[0].y0, bands[0].y1);
+
+    pthread_mutex_lock(&rasterMutex);
+    while (pendingBands)
+    {
+        pthread_cond_wait(&doneCond, &rasterMutex);
+    }
+    pthread_mutex_unlock(&rasterMutex);
+
+    BuildPyramid();
+
+    /* Keep the visible cubes in their order */
+    culledCount = 0;
+    size_t kept = 0;
+    for (size_t i = 0; i < list.records.size(); ++i)
+    {
+        if (IsOccluded(*list.records[i].cube, pvm))
+        {
+            culledCount++;
+            list.triangleCount -= list.records[i].triangleCount;
+            continue;
+        }
+        list.records[kept++] = list.records[i];
+    }
+    list.records.resize(kept);
+
+    return culledCount;
+}
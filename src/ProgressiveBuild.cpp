@@ -0,0 +1,189 @@
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+#include <cstring>
+#include <sys/time.h>
+#include "ProgressiveBuild.h"
+#include "MeshSimplifier.h"
+#include "Chrono.h"
+#include "Trace.h"
+
+static void *BuildThread(void *arg)
+{
+    SC_TRACE_THREAD("build");
+    ((ProgressiveBuild *)arg)->Run();
+    return NULL;
+}
+
+void ProgressiveBuild::Run()
+{
+    /* Highest resolution LOD construction */
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+
+    hlod->lods[0] = new LOD(maxLevel);
+    TimerStart();
+    SC_TRACE_BEGIN(leafZone, "BuildLeafLevel");
+    hlod->BuildLODFromInput(reader->meshData, reader->vertCount, reader->triCount);
+    int level = hlod->lods[0]->level;
+    SC_TRACE_END(leafZone);
+
+    cout << "\nMulti-Resolution Model building..." << endl;
+    cout << "LOD: " << level << " ";
+    TimerStop("build time: ");
+    cout << "cell: " << hlod->lods[0]->cubeTable.size() << " faces: "
+         << hlod->lods[0]->CalculateTriangleCounts() << " vertices: " << hlod->lods[0]->CalculateVertexCounts() << endl;
+    if (isAdaptive)
+    {
+        cout << "leaf faces: " << hlod->leafTriCount << " leaf vertices: " << hlod->leafVertCount << endl;
+    }
+    levelCount.store(level + 1);
+    builtLevels.store(1);
+
+    delete reader;
+    reader = NULL;
+
+    if (!HLODConsructor(hlod, level, errorThreshold, blockWidth, clusterDepth, &builtLevels, &isCancelled))
+    {
+        cout << "Multi-Resolution model build cancelled" << endl;
+        return;
+    }
+
+    gettimeofday(&end, NULL);
+    GetElapsedTime(start, end, "\nModel Reading and Multi-Resolution model build time: ");
+    cout << endl;
+
+    maxLevel = level;
+    isReady.store(true, memory_order_release);
+}
+
+void ProgressiveBuild::Start()
+{
+    isStarted = pthread_create(&thread, NULL, BuildThread, (void *)this) == 0;
+    if (!isStarted)
+    {
+        Run();
+    }
+}
+
+HLOD *ProgressiveBuild::Acquire()
+{
+    if (isTaken || !isReady.load(memory_order_acquire))
+    {
+        return NULL;
+    }
+    isTaken = true;
+    return hlod;
+}
+
+void ProgressiveBuild::Cancel()
+{
+    isCancelled.store(true);
+}
+
+void ProgressiveBuild::Join()
+{
+    if (isStarted)
+    {
+        pthread_join(thread, NULL);
+        isStarted = false;
+    }
+}
+
+void BuildProxy(ModelReader *reader, HLOD &proxy, size_t targetTriCount)
+{
+    Mesh *mesh = reader->meshData;
+
+    TimerStart();
+    for (size_t i = 0; i < reader->vertCount * 3; i += 3)
+    {
+        GetMaxMin(mesh->positions[i], mesh->positions[i + 1], mesh->positions[i + 2], proxy.min, proxy.max);
+    }
+
+    /* Vertex clustering on a uniform grid, no topology kept: fast enough to show something at once.
+     * A surface crosses about 2 * grid^2 cells, each cell gives about 2 triangles */
+    int grid = max(2, (int)sqrtf(0.5f * targetTriCount));
+    float length = max(proxy.max[0] - proxy.min[0], max(proxy.max[1] - proxy.min[1], proxy.max[2] - proxy.min[2]));
+    float step = length > 0.0f ? (grid - 1) / length : 0.0f;
+
+    unordered_map<uint64_t, uint32_t> cells;
+    vector<uint32_t> vertexToCell(reader->vertCount);
+    vector<float> sums;                             /* position and normal sums of the cells */
+    vector<uint32_t> counts;
+    for (size_t v = 0; v < reader->vertCount; ++v)
+    {
+        const float *p = &mesh->positions[3 * v];
+        uint64_t key = PackCoord((int)((p[0] - proxy.min[0]) * step), (int)((p[1] - proxy.min[1]) * step), (int)((p[2] - proxy.min[2]) * step));
+        auto cell = cells.emplace(key, (uint32_t)counts.size());
+        if (cell.second)
+        {
+            sums.resize(sums.size() + 6, 0.0f);
+            counts.push_back(0);
+        }
+        uint32_t c = cell.first->second;
+        vertexToCell[v] = c;
+        counts[c]++;
+        for (int k = 0; k < 3; ++k)
+        {
+            sums[6 * c + k] += p[k];
+            sums[6 * c + 3 + k] += mesh->normals[3 * v + k];
+        }
+    }
+
+    /* The triangles spanning three cells survive */
+    vector<uint32_t> indices;
+    indices.reserve(min(3 * targetTriCount, 3 * reader->triCount));
+    for (size_t t = 0; t < reader->triCount; ++t)
+    {
+        uint32_t a = vertexToCell[mesh->indices[3 * t]];
+        uint32_t b = vertexToCell[mesh->indices[3 * t + 1]];
+        uint32_t c = vertexToCell[mesh->indices[3 * t + 2]];
+        if (a != b && b != c && a != c)
+        {
+            indices.push_back(a);
+            indices.push_back(b);
+            indices.push_back(c);
+        }
+    }
+
+    size_t vertCount = counts.size();
+    Mesh &data = proxy.data;
+    data.positions = (float *)malloc(max(vertCount, (size_t)1) * VERTEX_STRIDE);
+    data.normals = (float *)malloc(max(vertCount, (size_t)1) * VERTEX_STRIDE);
+    data.remap = (uint32_t *)malloc(max(vertCount, (size_t)1) * sizeof(uint32_t));
+    data.indices = (uint32_t *)malloc(max(indices.size(), (size_t)1) * sizeof(uint32_t));
+    for (size_t c = 0; c < vertCount; ++c)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            data.positions[3 * c + k] = sums[6 * c + k] / counts[c];
+            data.normals[3 * c + k] = sums[6 * c + 3 + k];
+        }
+        data.remap[c] = c;
+    }
+    memcpy(data.indices, indices.data(), indices.size() * sizeof(uint32_t));
+    data.posCount = vertCount;
+    data.idxCount = indices.size();
+
+    /* One root cube, a leaf morphing to itself */
+    proxy.lods[0] = new LOD(0);
+    proxy.lods[0]->SetLOD(proxy.max, proxy.min);
+    Cube &cube = proxy.lods[0]->cubeTable[PackCoord(0, 0, 0)];
+    cube.coord[0] = cube.coord[1] = cube.coord[2] = 0;
+    cube.coord64 = PackCoord(0, 0, 0);
+    cube.ComputeBottomVertex(cube.bottom, cube.coord, proxy.lods[0]->cubeLength, proxy.min);
+    cube.vertCount = vertCount;
+    cube.triangleCount = indices.size() / 3;
+    cube.isLeaf = true;
+    cube.ComputeTightBounds(data.positions, vertCount, NULL, 0);
+    proxy.lods[0]->totalTriCount = cube.triangleCount;
+    proxy.lods[0]->totalVertCount = vertCount;
+    proxy.LinkCubes(0);
+
+    /* The input counts, shown as the original model */
+    proxy.leafTriCount = reader->triCount;
+    proxy.leafVertCount = reader->vertCount;
+
+    cout << "Proxy: " << cube.triangleCount << " faces " << vertCount << " vertices ";
+    TimerStop("build time: ");
+}
@@ -0,0 +1,44 @@
+#include "RenderList.h"
+
+void RenderList::Clear()
+{
+    records.clear();
+    triangleCount = 0;
+}
+
+void RenderList::Push(LOD *meshbook[], int lodIdx, Cube &cube, float distance)
+{
+    DrawRecord record;
+    record.cube = &cube;
+    record.idxByteOffset = cube.idxByteOffset;
+    record.indexSize = cube.indexSize;
+    record.vertexOffset = cube.vertexOffset;
+    record.triangleCount = cube.triangleCount;
+    record.level = meshbook[lodIdx]->level;
+    record.lodIdx = lodIdx;
+    record.distance = distance;
+    record.parentBase = cube.parentBase;
+
+    records.push_back(record);
+    triangleCount += cube.triangleCount;
+}
+
+void RenderList::SortFrontToBack()
+{
+    sort(records.begin(), records.end(), [](const DrawRecord &a, const DrawRecord &b) { return a.distance < b.distance; });
+}
+
+void RenderListExchange::Publish()
+{
+    back = (RenderList *)(middle.exchange((uintptr_t)back | 1, memory_order_acq_rel) & ~(uintptr_t)1);
+}
+
+bool RenderListExchange::Acquire()
+{
+    if (!(middle.load(memory_order_acquire) & 1))
+    {
+        return false;
+    }
+    front = (RenderList *)(middle.exchange((uintptr_t)front, memory_order_acq_rel) & ~(uintptr_t)1);
+    return true;
+}
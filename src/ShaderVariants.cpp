@@ -0,0 +1,202 @@
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <sys/stat.h>
+#include "ShaderVariants.h"
+
+static const char *SC_SHADER_DEFINES[SC_SHADER_FEATURES] = {"ADAPTIVE", "SMOOTH_SHADING", "LOD_COLOR", "CUBE_COLOR"};
+static const char SC_BINARY_MAGIC[4] = {'S', 'C', 'P', 'B'};
+
+/* FNV-1a, stable from one run to the next */
+static uint64_t HashString(const string &str, uint64_t hash = 14695981039346656037ull)
+{
+    for (unsigned char c : str)
+    {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static bool ReadFile(const string &file, string &code)
+{
+    ifstream in(file);
+    if (!in.is_open())
+    {
+        cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << file << endl;
+        return false;
+    }
+    stringstream stream;
+    stream << in.rdbuf();
+    code = stream.str();
+    return true;
+}
+
+bool ShaderVariants::Load(const string &vertexPath, const string &fragmentPath, const string &cacheDir)
+{
+    if (!ReadFile(vertexPath, vertexCode) || !ReadFile(fragmentPath, fragmentCode))
+    {
+        return false;
+    }
+
+    cachePrefix.clear();
+    if (!cacheDir.empty())
+    {
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        mkdir(cacheDir.c_str(), 0755);
+        if (formatCount > 0)
+        {
+            size_t nameStart = vertexPath.find_last_of('/') + 1;
+            cachePrefix = cacheDir + "/" + vertexPath.substr(nameStart, vertexPath.find_last_of('.') - nameStart) + "_";
+        }
+    }
+    return true;
+}
+
+string ShaderVariants::Inject(const string &code, unsigned features)
+{
+    string defines = this->defines;
+    for (int i = 0; i < SC_SHADER_FEATURES; ++i)
+    {
+        if (features & (1u << i))
+        {
+            defines += string("#define ") + SC_SHADER_DEFINES[i] + "\n";
+        }
+    }
+
+    size_t lineEnd = code.find('\n', code.find("#version"));
+    if (lineEnd == string::npos)
+    {
+        return defines + code;
+    }
+    return code.substr(0, lineEnd + 1) + defines + code.substr(lineEnd + 1);
+}
+
+Shader *ShaderVariants::Get(unsigned features)
+{
+    /* One colouring at a time */
+    if (features & SC_SHADER_LOD_COLOR)
+    {
+        features &= ~SC_SHADER_CUBE_COLOR;
+    }
+    if (programs[features])
+    {
+        return programs[features];
+    }
+
+    string vertex = Inject(vertexCode, features);
+    string fragment = Inject(fragmentCode, features);
+    Shader *program = new Shader();
+
+    /* A binary only fits the driver that wrote it and the sources it came from */
+    string file;
+    uint64_t key = 0;
+    if (!cachePrefix.empty())
+    {
+        file = cachePrefix + to_string(features) + ".bin";
+        key = HashString((const char *)glGetString(GL_VENDOR));
+        key = HashString((const char *)glGetString(GL_RENDERER), key);
+        key = HashString((const char *)glGetString(GL_VERSION), key);
+        key = HashString(vertex, key);
+        key = HashString(fragment, key);
+    }
+
+    if (!file.empty() && LoadBinary(program, file, key))
+    {
+        loadedCount++;
+    }
+    else
+    {
+        program->BuildSource(vertex, fragment, "", !file.empty());
+        compiledCount++;
+        if (!file.empty())
+        {
+            SaveBinary(program, file, key);
+        }
+    }
+
+    programs[features] = program;
+    return program;
+}
+
+bool ShaderVariants::LoadBinary(Shader *program, const string &file, uint64_t key)
+{
+    ifstream in(file, ios::binary);
+    if (!in.is_open())
+    {
+        return false;
+    }
+
+    char magic[4];
+    uint64_t fileKey = 0;
+    GLenum format = 0;
+    GLint length = 0;
+    in.read(magic, sizeof(magic));
+    in.read((char *)&fileKey, sizeof(fileKey));
+    in.read((char *)&format, sizeof(format));
+    in.read((char *)&length, sizeof(length));
+    if (!in || memcmp(magic, SC_BINARY_MAGIC, sizeof(magic)) != 0 || fileKey != key || length <= 0)
+    {
+        return false;
+    }
+
+    vector<char> binary(length);
+    if (!in.read(binary.data(), length))
+    {
+        return false;
+    }
+
+    /* The driver may still reject it, e.g. after an update that kept the version string */
+    program->ID = glCreateProgram();
+    glProgramBinary(program->ID, format, binary.data(), length);
+    GLint isLinked = GL_FALSE;
+    glGetProgramiv(program->ID, GL_LINK_STATUS, &isLinked);
+    if (!isLinked)
+    {
+        glDeleteProgram(program->ID);
+        program->ID = 0;
+        return false;
+    }
+    program->ResolveUniforms();
+    return true;
+}
+
+void ShaderVariants::SaveBinary(Shader *program, const string &file, uint64_t key)
+{
+    GLint length = 0;
+    glGetProgramiv(program->ID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return;
+    }
+
+    vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program->ID, length, &length, &format, binary.data());
+
+    ofstream out(file, ios::binary);
+    if (!out.is_open())
+    {
+        return;
+    }
+    out.write(SC_BINARY_MAGIC, sizeof(SC_BINARY_MAGIC));
+    out.write((const char *)&key, sizeof(key));
+    out.write((const char *)&format, sizeof(format));
+    out.write((const char *)&length, sizeof(length));
+    out.write(binary.data(), length);
+}
+
+void ShaderVariants::Destroy()
+{
+    for (int i = 0; i < SC_SHADER_VARIANTS; ++i)
+    {
+        if (programs[i])
+        {
+            glDeleteProgram(programs[i]->ID);
+            delete programs[i];
+            programs[i] = NULL;
+        }
+    }
+}
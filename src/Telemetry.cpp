@@ -0,0 +1,163 @@
+#include <cmath>
+#include <iostream>
+#include "Telemetry.h"
+
+static void *WriteTelemetry(void *arg)
+{
+    return ((TelemetryWriter *)arg)->WriteLoop();
+}
+
+bool TelemetryWriter::Open(const string &fileName, const vector<string> &columnNames)
+{
+    if (isRunning || columnNames.empty() || columnNames.size() > (size_t)SC_TELEMETRY_COLUMNS)
+    {
+        return false;
+    }
+    file = fopen(fileName.c_str(), "w");
+    if (!file)
+    {
+        cout << "Cannot open the telemetry file " << fileName << endl;
+        return false;
+    }
+    setvbuf(file, NULL, _IOFBF, SC_TELEMETRY_BUFFER);
+    isJson = fileName.size() > 5 && fileName.compare(fileName.size() - 5, 5, ".json") == 0;
+    columns = columnNames;
+    writtenCount = 0;
+
+    if (isJson)
+    {
+        fprintf(file, "[");
+    }
+    else
+    {
+        for (size_t c = 0; c < columns.size(); ++c)
+        {
+            fprintf(file, c ? ",%s" : "%s", columns[c].c_str());
+        }
+        fprintf(file, "\n");
+    }
+
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&rowCond, NULL);
+    isRunning = true;
+    if (pthread_create(&writer, NULL, WriteTelemetry, (void *)this))
+    {
+        isRunning = false;
+        pthread_cond_destroy(&rowCond);
+        pthread_mutex_destroy(&mutex);
+        fclose(file);
+        file = NULL;
+        return false;
+    }
+    return true;
+}
+
+void TelemetryWriter::Push(const double *values)
+{
+    TelemetryRow row;
+    for (size_t c = 0; c < columns.size(); ++c)
+    {
+        row.values[c] = values[c];
+    }
+
+    pthread_mutex_lock(&mutex);
+    rows.push_back(row);
+    if (rows.size() >= SC_TELEMETRY_BATCH)
+    {
+        pthread_cond_signal(&rowCond);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+void *TelemetryWriter::WriteLoop()
+{
+    vector<TelemetryRow> batch;
+    while (true)
+    {
+        pthread_mutex_lock(&mutex);
+        while (rows.size() < SC_TELEMETRY_BATCH && isRunning)
+        {
+            pthread_cond_wait(&rowCond, &mutex);
+        }
+        bool isStopping = !isRunning;
+        batch.swap(rows);
+        pthread_mutex_unlock(&mutex);
+
+        WriteRows(batch);
+        batch.clear();
+        if (isStopping)
+        {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* Counts in full, times with six digits. NaN and infinity have no JSON number: null, an empty CSV field */
+static void WriteValue(FILE *file, double value, bool isJson)
+{
+    if (!isfinite(value))
+    {
+        if (isJson)
+        {
+            fprintf(file, "null");
+        }
+    }
+    else if (value == floor(value) && fabs(value) < 1e15)
+    {
+        fprintf(file, "%.0f", value);
+    }
+    else
+    {
+        fprintf(file, "%.6g", value);
+    }
+}
+
+void TelemetryWriter::WriteRows(const vector<TelemetryRow> &batch)
+{
+    for (const TelemetryRow &row : batch)
+    {
+        if (isJson)
+        {
+            fprintf(file, writtenCount ? ",\n{" : "\n{");
+            for (size_t c = 0; c < columns.size(); ++c)
+            {
+                fprintf(file, c ? ",\"%s\":" : "\"%s\":", columns[c].c_str());
+                WriteValue(file, row.values[c], isJson);
+            }
+            fprintf(file, "}");
+        }
+        else
+        {
+            for (size_t c = 0; c < columns.size(); ++c)
+            {
+                fprintf(file, c ? "," : "");
+                WriteValue(file, row.values[c], isJson);
+            }
+            fprintf(file, "\n");
+        }
+        writtenCount++;
+    }
+}
+
+void TelemetryWriter::Close()
+{
+    if (!isRunning)
+    {
+        return;
+    }
+    pthread_mutex_lock(&mutex);
+    isRunning = false;
+    pthread_cond_signal(&rowCond);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(writer, NULL);
+
+    if (isJson)
+    {
+        fprintf(file, "\n]\n");
+    }
+    fclose(file);
+    file = NULL;
+    pthread_cond_destroy(&rowCond);
+    pthread_mutex_destroy(&mutex);
+}
@@ -0,0 +1,200 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <pthread.h>
+#include "Trace.h"
+
+#ifdef SC_TRACE
+
+/* Complete event, nanoseconds since the start of the process */
+struct TraceEvent
+{
+    const char *name;
+    const char *argName;
+    int64_t value;
+    uint64_t start;
+    uint64_t end;
+};
+
+/* Events of one thread at a time: only its thread appends, the chunks never move so the writer
+ * reads the published count without a lock */
+struct TraceBuffer
+{
+    unsigned id = 0;
+    const char *threadName = NULL;
+    bool isFree = false;
+    TraceEvent *chunks[SC_TRACE_MAX_CHUNKS] = {};
+    atomic<size_t> count{0};
+    atomic<size_t> droppedCount{0};
+};
+
+/* Returns the buffer to the pool when the thread exits */
+struct TraceThread
+{
+    TraceBuffer *buffer = NULL;
+    ~TraceThread();
+};
+
+static const chrono::steady_clock::time_point traceEpoch = chrono::steady_clock::now();
+static pthread_mutex_t traceMutex = PTHREAD_MUTEX_INITIALIZER;  /* buffer list, thread names */
+static vector<TraceBuffer *> traceBuffers;                      /* never freed, the trace outlives the threads */
+static thread_local TraceThread traceThread;
+
+static uint64_t TraceNow()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - traceEpoch).count();
+}
+
+static bool IsSameName(const char *a, const char *b)
+{
+    return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+static TraceBuffer *AcquireBuffer(const char *name)
+{
+    pthread_mutex_lock(&traceMutex);
+    TraceBuffer *buffer = NULL;
+    for (TraceBuffer *b : traceBuffers)
+    {
+        if (b->isFree && IsSameName(b->threadName, name))
+        {
+            buffer = b;
+            break;
+        }
+    }
+    if (!buffer)
+    {
+        buffer = new TraceBuffer;
+        buffer->id = traceBuffers.size() + 1;
+        buffer->threadName = name;
+        traceBuffers.push_back(buffer);
+    }
+    buffer->isFree = false;
+    pthread_mutex_unlock(&traceMutex);
+    return buffer;
+}
+
+TraceThread::~TraceThread()
+{
+    if (buffer)
+    {
+        pthread_mutex_lock(&traceMutex);
+        buffer->isFree = true;
+        pthread_mutex_unlock(&traceMutex);
+    }
+}
+
+static void TracePush(const TraceEvent &event)
+{
+    if (!traceThread.buffer)
+    {
+        traceThread.buffer = AcquireBuffer(NULL);
+    }
+    TraceBuffer *buffer = traceThread.buffer;
+
+    size_t n = buffer->count.load(memory_order_relaxed);
+    size_t chunk = n / SC_TRACE_CHUNK_EVENTS;
+    if (chunk >= SC_TRACE_MAX_CHUNKS)
+    {
+        buffer->droppedCount.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    if (!buffer->chunks[chunk])
+    {
+        buffer->chunks[chunk] = new TraceEvent[SC_TRACE_CHUNK_EVENTS];
+    }
+    buffer->chunks[chunk][n % SC_TRACE_CHUNK_EVENTS] = event;
+    buffer->count.store(n + 1, memory_order_release);
+}
+
+TraceZone::TraceZone(const char *zoneName, const char *zoneArgName, int64_t zoneValue)
+    : name(zoneName), argName(zoneArgName), value(zoneValue), start(TraceNow())
+{
+}
+
+TraceZone::~TraceZone()
+{
+    End();
+}
+
+void TraceZone::End()
+{
+    if (name)
+    {
+        TracePush({name, argName, value, start, TraceNow()});
+        name = NULL;
+    }
+}
+
+void TraceThreadName(const char *name)
+{
+    if (!traceThread.buffer)
+    {
+        traceThread.buffer = AcquireBuffer(name);
+        return;
+    }
+    pthread_mutex_lock(&traceMutex);
+    traceThread.buffer->threadName = name;
+    pthread_mutex_unlock(&traceMutex);
+}
+
+bool TraceWrite(const string &file)
+{
+    FILE *out = fopen(file.c_str(), "w");
+    if (!out)
+    {
+        printf("Cannot open the trace file %s\n", file.c_str());
+        return false;
+    }
+
+    /* Zone and thread names are string literals of the code, nothing to escape */
+    size_t eventCount = 0, droppedCount = 0;
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"viewer\"}}");
+    pthread_mutex_lock(&traceMutex);
+    for (TraceBuffer *buffer : traceBuffers)
+    {
+        if (buffer->threadName)
+        {
+            fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", buffer->id, buffer->threadName);
+        }
+        size_t count = buffer->count.load(memory_order_acquire);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const TraceEvent &e = buffer->chunks[i / SC_TRACE_CHUNK_EVENTS][i % SC_TRACE_CHUNK_EVENTS];
+            fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u",
+                    e.name, e.start / 1000.0, (e.end - e.start) / 1000.0, buffer->id);
+            if (e.argName)
+            {
+                fprintf(out, ",\"args\":{\"%s\":%lld}", e.argName, (long long)e.value);
+            }
+            fprintf(out, "}");
+        }
+        eventCount += count;
+        droppedCount += buffer->droppedCount.load(memory_order_relaxed);
+    }
+    size_t threadCount = traceBuffers.size();
+    pthread_mutex_unlock(&traceMutex);
+    fprintf(out, "\n]}\n");
+    fclose(out);
+
+    printf("Trace: %zu events of %zu threads written to %s", eventCount, threadCount, file.c_str());
+    if (droppedCount)
+    {
+        printf(", %zu dropped", droppedCount);
+    }
+    printf("\n");
+    return true;
+}
+
+#else
+
+bool TraceWrite(const string &file)
+{
+    printf("Cannot write %s, tracing needs: make TRACE=1\n", file.c_str());
+    return false;
+}
+
+#endif
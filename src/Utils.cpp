@@ -1,4 +1,6 @@
 #include "Utils.h"
+#include <cstring>
+#include "CpuDispatch.h"
 
 ModelAttributesStatus modelAttriSatus = {false, false, false, false};
 
@@ -18,34 +20,26 @@ float *ComputeNormal(float *vertices, uint32_t *indices, size_t vertCount, size_
         normals[i] = 0.0f;
     }
 
+    /* Face normals by the vector kernel, summed on the unique positions */
+    float *faceNormals = (float *)malloc(indexCount * sizeof(float));
+    cpuKernels.faceNormals(vertices, indices, indexCount, faceNormals);
     for (size_t i = 0; i < indexCount; i = i + 3)
     {
-        Vec3 v1, v2, v3, n;
-        v1.x = vertices[3 * indices[i]], v1.y = vertices[3 * indices[i] + 1], v1.z = vertices[3 * indices[i] + 2];
-        v2.x = vertices[3 * indices[i + 1]], v2.y = vertices[3 * indices[i + 1] + 1], v2.z = vertices[3 * indices[i + 1] + 2];
-        v3.x = vertices[3 * indices[i + 2]], v3.y = vertices[3 * indices[i + 2] + 1], v3.z = vertices[3 * indices[i + 2] + 2];
-
-        n = normalized(cross(v2 - v1, v3 - v1));
-
-        normals[3 * remap[indices[i]]] += n.x, normals[3 * remap[indices[i]] + 1] += n.y, normals[3 * remap[indices[i]] + 2] += n.z;
-        normals[3 * remap[indices[i + 1]]] += n.x, normals[3 * remap[indices[i + 1]] + 1] += n.y, normals[3 * remap[indices[i + 1]] + 2] += n.z;
-        normals[3 * remap[indices[i + 2]]] += n.x, normals[3 * remap[indices[i + 2]] + 1] += n.y, normals[3 * remap[indices[i + 2]] + 2] += n.z;
+        float *n = &faceNormals[i];
+        normals[3 * remap[indices[i]]] += n[0], normals[3 * remap[indices[i]] + 1] += n[1], normals[3 * remap[indices[i]] + 2] += n[2];
+        normals[3 * remap[indices[i + 1]]] += n[0], normals[3 * remap[indices[i + 1]] + 1] += n[1], normals[3 * remap[indices[i + 1]] + 2] += n[2];
+        normals[3 * remap[indices[i + 2]]] += n[0], normals[3 * remap[indices[i + 2]] + 1] += n[1], normals[3 * remap[indices[i + 2]] + 2] += n[2];
     }
+    MemoryFree(faceNormals);
 
-    for (size_t i = 0; i < vertCount; ++i)
+    /* remap[i] <= i: from the last vertex down, the sum of a unique position is read before its slot is written */
+    cpuKernels.normalize(normals, uniqueVertexCount);
+    for (size_t i = vertCount; i-- > 0;)
     {
-        Vec3 n;
-        if (remap[i] == i)
+        if (remap[i] != i)
         {
-            n.x = normals[3 * i], n.y = normals[3 * i + 1], n.z = normals[3 * i + 2];
+            memcpy(&normals[3 * i], &normals[3 * remap[i]], 3 * sizeof(float));
         }
-        else
-        {
-            n.x = normals[3 * remap[i]], n.y = normals[3 * remap[i] + 1], n.z = normals[3 * remap[i] + 2];
-        }
-
-        n = normalized(n);
-        normals[3 * i] = n.x, normals[3 * i + 1] = n.y, normals[3 * i + 2] = n.z;
     }
 
     MemoryFree(remap);
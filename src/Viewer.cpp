@@ -254,4 +254,15 @@ void Viewer::ProcessInput(GLFWwindow *window)
 	{
 		isFreezeFrame = false;
 	}
+
+	/* Start and stop the camera path recording */
+	if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS)
+	{
+		isRecordPath = true;
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS)
+	{
+		isRecordPath = false;
+	}
 }
\ No newline at end of file
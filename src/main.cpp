@@ -5,6 +5,9 @@
 #include "Display.h"
 #include "MeshSimplifier.h"
 #include "Chrono.h"
+#include "ProgressiveBuild.h"
+#include "CpuDispatch.h"
+#include "Trace.h"
 
 const float errSimplify = 0.01;
 const unsigned TargetCubeIndexCount = 1 << 15;
@@ -14,36 +17,162 @@ using namespace std;
 /**
  * @param   arg1 file path of 3D model
  * @param   arg2 enable/disable quantization
- * @param   arg3 maximum level of multi-resolution model (optional)
+ * @param   arg3 maximum level of multi-resolution model (optional, uniform depth)
  * @param   arg4 error threshold for mesh simplification (optional)
+ * @param   arg5 width of the simplification blocks in cubes (optional)
+ * @param   arg6 levels coarser than this depth are simplified by vertex clustering, 0 for none (optional)
+ * @param   --headless path     render offscreen along a camera path file or "turntable:N" (optional)
+ * @param   --size WxH          offscreen frame size (optional)
+ * @param   --out dir           directory of timings.csv and the frames (optional)
+ * @param   --images            write one PNG per offscreen frame (optional)
+ * @param   --bench-simplify    time the scalar and SIMD simplifier on the leaf blocks, then exit (optional)
+ * @param   --bench-kernels     time the vector kernels on each instruction set of the CPU, then exit (optional)
+ * @param   --cpu sse2|avx2|avx512  highest instruction set of the vector kernels (optional, the CPU's by default)
+ * @param   --trace file        write the zones of the run as Chrome trace JSON, needs make TRACE=1 (optional)
+ * @param   --adaptive          leaf depth adapted to the local triangle density when the level is not given (optional)
  * @return  Description of the return value.
  */
 
 int main(int argc, char *argv[])
 {
+    /* Offscreen options, the positional arguments are the remaining ones */
+    HeadlessParams headless;
+    bool isHeadless = false;
+    bool isBenchSimplify = false;
+    bool isBenchKernels = false;
+    CpuLevel cpuLevel = SC_CPU_AVX512;
+    string traceFile;
+    bool isAdaptiveSubdivision = false;
+    bool isUsage = false;
+    int argCount = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--headless" && i + 1 < argc)
+        {
+            headless.pathFile = argv[++i];
+            isHeadless = true;
+        }
+        else if (arg == "--size" && i + 1 < argc)
+        {
+            const char *size = argv[++i];
+            int width, height;
+            char extra;
+            if (sscanf(size, "%dx%d%c", &width, &height, &extra) == 2 && width > 0 && height > 0)
+            {
+                headless.width = width;
+                headless.height = height;
+            }
+            else
+            {
+                cout << "invalid frame size " << size << ", expected WxH" << endl;
+                isUsage = true;
+            }
+        }
+        else if (arg == "--out" && i + 1 < argc)
+        {
+            headless.outputDir = argv[++i];
+        }
+        else if (arg == "--images")
+        {
+            headless.isSaveImage = true;
+        }
+        else if (arg == "--bench-simplify")
+        {
+            isBenchSimplify = true;
+        }
+        else if (arg == "--bench-kernels")
+        {
+            isBenchKernels = true;
+        }
+        else if (arg == "--cpu" && i + 1 < argc)
+        {
+            string level = argv[++i];
+            if (level == "sse2")
+            {
+                cpuLevel = SC_CPU_SSE2;
+            }
+            else if (level == "avx2")
+            {
+                cpuLevel = SC_CPU_AVX2;
+            }
+            else if (level == "avx512")
+            {
+                cpuLevel = SC_CPU_AVX512;
+            }
+            else
+            {
+                cout << "unknown instruction set " << level << endl;
+                isUsage = true;
+            }
+        }
+        else if (arg == "--trace" && i + 1 < argc)
+        {
+            traceFile = argv[++i];
+        }
+        else if (arg == "--adaptive")
+        {
+            isAdaptiveSubdivision = true;
+        }
+        else
+        {
+            argv[argCount++] = argv[i];
+        }
+    }
+    argc = argCount;
+
+    if (argc < 2 || isUsage)
+    {
+        cout << "usage: " << argv[0] << " model [quantization level error blockWidth clusterDepth] [--headless path|turntable:N] [--size WxH] [--out dir] [--images] [--bench-simplify] [--bench-kernels] [--cpu sse2|avx2|avx512] [--trace file] [--adaptive]" << endl;
+        return 1;
+    }
+
     string filePath = argv[1];
+    SC_TRACE_THREAD("main");
+
+    cpuLevel = SelectCpuKernels(cpuLevel);
+    cout << "Vector kernels: " << CpuLevelName(cpuLevel) << endl;
 
     /* Read geometry data from model */
     ModelReader *modelReader = new ModelReader;
     TimerStart();
+    SC_TRACE_BEGIN(readZone, "ReadModel");
     modelReader->InputModel(filePath);
+    SC_TRACE_END(readZone);
     TimerStop("Model Read time: ");
 
     TimerStart();
     if (!modelAttriSatus.hasNormal)
     {
+        SC_TRACE_ZONE("CalculateNormals");
         modelReader->CalculateNormals();
     }
     TimerStop("Nomral Calculation time: ");
 
+    if (isBenchKernels)
+    {
+        BenchmarkKernels(modelReader->meshData->positions, modelReader->vertCount, modelReader->meshData->indices, modelReader->triCount * 3);
+        return 0;
+    }
+
     /* Set the LOD level automatically */
-    int level = 2;
+    int level = SC_MIN_LOD_LEVEL;
     float errorThreshold = errSimplify;
+    bool isAdaptive = false;
     if (argc < 5)
     {
-        while (((1 << level) * (1 << level) * TargetCubeIndexCount) < 3 * modelReader->triCount)
+        if (isAdaptiveSubdivision)
         {
-            level++;
+            /* Maximum depth, the leaf cubes stop as soon as they fit the budget */
+            level = SC_MAX_LOD_LEVEL - 1;
+            isAdaptive = true;
+        }
+        else
+        {
+            while (((1 << level) * (1 << level) * TargetCubeIndexCount) < 3 * modelReader->triCount)
+            {
+                level++;
+            }
         }
     }
     else
@@ -53,31 +182,53 @@ int main(int argc, char *argv[])
     }
 
     /* Multi-resolution model */
-    HLOD multiResoModel;
-    multiResoModel.lods[0] = new LOD(level);
+    HLOD *multiResoModel = new HLOD;
+    multiResoModel->leafTriBudget = isAdaptive ? TargetCubeIndexCount / 3 : 0;
 
-    /* Highest resolution LOD construction */
-    struct timeval start, end;
-    gettimeofday(&start, NULL);
+    ProgressiveBuild build;
+    build.reader = modelReader;
+    build.hlod = multiResoModel;
+    build.maxLevel = level;
+    build.errorThreshold = errorThreshold;
+    build.blockWidth = argc > 5 ? atoi(argv[5]) : SC_BLOCK_SIZE;
+    build.clusterDepth = argc > 6 ? atoi(argv[6]) : SC_CLUSTER_DEPTH;
+    build.isAdaptive = isAdaptive;
 
-    TimerStart();
-    multiResoModel.BuildLODFromInput(modelReader->meshData, modelReader->vertCount, modelReader->triCount);
-
-    cout << "\nMulti-Resolution Model building..." << endl;
-    cout << "LOD: " << level << " ";
-    TimerStop("build time: ");
-    cout << "cell: " << multiResoModel.lods[0]->cubeTable.size() << " faces: "
-         << multiResoModel.lods[0]->CalculateTriangleCounts() << " vertices: " << multiResoModel.lods[0]->CalculateVertexCounts() << endl;
-
-    delete modelReader;
+    /* The leaf level is enough for the simplifier benchmark */
+    if (isBenchSimplify)
+    {
+        multiResoModel->lods[0] = new LOD(level);
+        multiResoModel->BuildLODFromInput(modelReader->meshData, modelReader->vertCount, modelReader->triCount);
+        BenchmarkSimplification(multiResoModel, build.blockWidth, errorThreshold);
+        return 0;
+    }
 
-    HLODConsructor(&multiResoModel, level, errorThreshold);
+    /* Offscreen runs time the full model, built first */
+    if (isHeadless)
+    {
+        build.Run();
+        cout << "\nAdpative LOD Rendering..." << endl;
+        int result = Display(*multiResoModel, build.maxLevel, &headless);
+        if (!traceFile.empty())
+        {
+            TraceWrite(traceFile);
+        }
+        return result < 0;
+    }
 
-    gettimeofday(&end, NULL);
-    GetElapsedTime(start, end, "\nModel Reading and Multi-Resolution model build time: ");
+    /* The window opens on a coarse proxy, the hierarchy replaces it once built */
+    HLOD proxy;
+    BuildProxy(modelReader, proxy, SC_PROXY_TRIANGLES);
+    build.Start();
 
     /* Display */
     cout << "\nAdpative LOD Rendering..." << endl;
-    Display(multiResoModel, level);
-    return 0;
-}
\ No newline at end of file
+    int result = Display(proxy, 0, NULL, &build);
+    build.Cancel();
+    build.Join();
+    if (!traceFile.empty())
+    {
+        TraceWrite(traceFile);
+    }
+    return result < 0;
+}